@@ -23,17 +23,19 @@ FREETYPEINC = /usr/include/freetype2
 
 # includes and libs
 INCS = -I${X11INC} -I${FREETYPEINC}
-LIBS = -L${X11LIB} -lX11 ${XINERAMALIBS} ${FREETYPELIBS} -lXrender
+LIBS = -L${X11LIB} -lX11 -lX11-xcb -lxcb ${XINERAMALIBS} ${FREETYPELIBS} -lXrender
 
 # flags
 CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_XOPEN_SOURCE=700L -DVERSION=\"${VERSION}\" ${XINERAMAFLAGS}
 #CFLAGS   = -g -std=c99 -pedantic -Wall -O0 ${INCS} ${CPPFLAGS}
 CFLAGS   = -std=c99 -pedantic -Wall -Wno-deprecated-declarations -ggdb ${INCS} ${CPPFLAGS}
 CFLAGS	+= -Wno-incompatible-pointer-types
-
-ifdef HAVE_USE_SIGACTION_SIGCHLD
-CFLAGS += -DHAVE_USE_SIGACTION_SIGCHLD
-endif
+# poison freed client records and die on double frees (uncomment)
+#CPPFLAGS += -DPOOLDEBUG
+# check the client lists after every event batch (uncomment)
+#CPPFLAGS += -DLISTDEBUG
+# report redundant X requests the shadow state dropped on exit (uncomment)
+#CPPFLAGS += -DSHADOWDEBUG
 
 LDFLAGS  = ${LIBS}
 
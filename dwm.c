@@ -27,13 +27,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <X11/cursorfont.h>
 #include <X11/keysym.h>
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/Xproto.h>
 #include <X11/Xutil.h>
 #ifdef XINERAMA
@@ -55,7 +60,12 @@
 #define WIDTH(X)                ((X)->w + 2 * (X)->bw)
 #define HEIGHT(X)               ((X)->h + 2 * (X)->bw)
 #define TAGMASK                 ((1 << LENGTH(tags)) - 1)
+#define MAXTAGS                 31  /* tags that fit in an unsigned int mask */
+#define MAXNETSTATE             32  /* _NET_WM_STATE atoms kept per client */
 #define TEXTW(X)                (drw_fontset_getwidth(drw, (X)) + lrpad)
+#define BATCHSIZE               256 /* max events dispatched per batch */
+#define IDLEDEADLINE            100 /* ms idle work may wait during a flood */
+#define BACKLOG                 32  /* batch size from which cosmetic events wait */
 
 //xtile
 #define GETINC(X)               ((X) < 0 ? X + 1000 : X - 1000)
@@ -64,6 +74,9 @@
 #define MOD(N,M)                ((N)%(M) < 0 ? (N)%(M) + (M) : (N)%(M))
 #define PREVSEL                 3000
 #define TRUNC(X,A,B)            (MAX((A), MIN((X), (B))))
+/* true, and counted, if S already records V for field F; records it otherwise */
+#define SHADOWED(S,B,F,V)       ((S)->known & (B) && (S)->F == (V) ? (suppressed++, 1) \
+                                 : ((S)->F = (V), (S)->known |= (B), 0))
 
 #define SYSTEM_TRAY_REQUEST_DOCK    0
 /* XEMBED messages */
@@ -87,7 +100,7 @@ enum { NetSupported, NetWMName, NetWMState, NetWMCheck,
        NetWMWindowTypeDock,
        NetWMWindowOpacity,
        NetWMWindowTypeDesktop,
-       NetWMWindowTypeDialog, NetClientList,
+       NetWMWindowTypeDialog, NetClientList, NetClientListStacking,
        NetWMPid,
        NetDesktopNames, NetNumberOfDesktops,
        NetCurrentDesktop, NetWMDesktop,
@@ -96,10 +109,29 @@ enum { NetSupported, NetWMName, NetWMState, NetWMCheck,
 enum { Manager, Xembed, XembedInfo, XLast }; /* Xembed atoms */
 enum { WMProtocols, WMDelete, WMState, WMTakeFocus, WMLast }; /* default atoms */
 enum { DWMTags, DWMLast };                              /* DWM atoms */
+enum { ProtoDelete = 1 << 0, ProtoTakeFocus = 1 << 1 }; /* WM_PROTOCOLS we use */
+enum { PfNormalHints, PfNetWMName, PfWMName, PfPid, PfTransient, PfClass,
+       PfState, PfType, PfHints, PfTags, PfProtocols, PfLast }; /* prefetched properties */
 enum { ClkTagBar, ClkLtSymbol, ClkStatusText, ClkWinTitle,
        ClkClientWin, ClkRootWin, ClkLast }; /* clicks */
 
 enum { DirHor, DirVer, DirRotHor, DirRotVer, DirLast }; /* tiling dirs */
+enum { IdleClientList = 1 << 0, IdleCurrentDesktop = 1 << 1,
+       IdleDesktopNames = 1 << 2, IdleTags = 1 << 3,
+       IdleSystray = 1 << 4, IdleStacking = 1 << 5 }; /* work deferred to idle() */
+enum { WinNone, WinClient, WinSwallowed, WinIcon, WinBar }; /* window kinds */
+enum { RuleClass, RuleInstance, RuleTitle, RuleLast }; /* Rule match fields */
+enum { PrioStructure, PrioCosmetic }; /* dispatch() classes */
+enum { LayerDesktop, LayerTiled, LayerFloating, LayerBar,
+       LayerFullscreen }; /* stacking layers, bottom to top */
+enum { ShBorder = 1 << 0, ShBorderWidth = 1 << 1, ShButtons = 1 << 2,
+       ShOpacity = 1 << 3, ShState = 1 << 4, ShTags = 1 << 5,
+       ShDesktop = 1 << 6, ShActive = 1 << 7 }; /* Shadow fields known */
+enum { DirtyLayout = 1 << 0, DirtyStack = 1 << 1, DirtyTags = 1 << 2,
+       DirtyTitle = 1 << 3, DirtyStatus = 1 << 4, DirtySystray = 1 << 5,
+       DirtyGeom = 1 << 6, DirtyNetState = 1 << 7,
+       DirtyBar = DirtyTags|DirtyTitle|DirtyStatus,
+       DirtyArrange = DirtyLayout|DirtyStack|DirtyTags|DirtyTitle }; /* monitor dirty bits */
 
 typedef union {
 	int i;
@@ -121,25 +153,66 @@ typedef struct {
 	const Arg arg;
 } Button;
 
+/* what the server last heard from us about a window; fields count only
+ * once their Sh* bit is in known, see SHADOWED() */
+typedef struct {
+	unsigned int known;
+	unsigned long border; /* border pixel */
+	int bw;
+	int buttons;          /* grabbuttons() focused argument */
+	double opacity;       /* -1: _NET_WM_WINDOW_OPACITY deleted */
+	long state;           /* WM_STATE */
+	unsigned int tags;    /* DWM_TAGS */
+	long desktop;         /* _NET_WM_DESKTOP, _NET_CURRENT_DESKTOP on root */
+	Window active;        /* _NET_ACTIVE_WINDOW on root, None: deleted */
+	Atom netstate[MAXNETSTATE]; /* _NET_WM_STATE as it should be, see netstateop() */
+	int nnetstate;
+	int netstatedirty;    /* netstate not yet sent, see commit() */
+} Shadow;
+
 typedef struct Monitor Monitor;
 typedef struct Client Client;
+typedef struct Clientinfo Clientinfo;
+/* the first 64 bytes hold everything list walks and layouts read; the
+ * pool starts every record on a cache line */
 struct Client {
+	Client *next;
+	Client *snext;
+	Monitor *mon;
+	Window win;
+	unsigned int tags;
+	char isfixed, isfloating, isurgent, neverfocus, isfullscreen, isdesktop;
+	signed char hidden; /* 1: parked off-screen, 0: shown, -1: unknown */
+	int x, y, w, h;
+	int bw;
+	int geomdirty; /* x, y, w, h not yet sent, see commit() */
+	int tagspending; /* DWM_TAGS waits for idle() */
+	int vispos, xvispos; /* visible clients ahead of this one, see updatevis() */
+	int raiseme;
+	int inclients, instack; /* on mon's client list, focus stack */
+	unsigned long raised; /* raise sequence, orders a layer's floaters */
+	unsigned long focused; /* stack sequence, orders the per-tag MRU lists */
+	Client *prev, *sprev;
+	Clientinfo *ci;
+};
+
+/* rarely touched client state, allocated alongside by newclient() */
+struct Clientinfo {
 	char name[256];
 	float mina, maxa;
-	int x, y, w, h;
 	int oldx, oldy, oldw, oldh;
 	int basew, baseh, incw, inch, maxw, maxh, minw, minh, hintsvalid;
-	int bw, oldbw;
-	unsigned int tags;
-	int isfixed, isfloating, isurgent, neverfocus, oldstate, isfullscreen, isterminal, noswallow, isdesktop;
+	int oldbw;
+	int oldstate, isterminal, noswallow;
 	pid_t pid;
-	Client *next;
-	Client *snext;
 	Client *swallowing;
-	Monitor *mon;
-	Window win;
 	double opacity;
-	int raiseme;
+	Client *tnext[MAXTAGS], *tprev[MAXTAGS]; /* per-tag MRU links */
+	Client *unext, *uprev; /* urgency FIFO links */
+	XWMHints wmh;          /* last WM_HINTS seen, for seturgent() */
+	int haswmh;            /* wmh is valid: the window set WM_HINTS */
+	unsigned int protocols; /* Proto* bits, see updateprotocols() */
+	Shadow sh;             /* follows win across swallows */
 };
 
 typedef struct {
@@ -149,6 +222,11 @@ typedef struct {
 	const Arg arg;
 } Key;
 
+typedef struct {
+	unsigned int mod;     /* CLEANMASK(keys[key].mod) */
+	int key;              /* index into keys[] */
+} KeyBind;
+
 typedef struct {
 	const char *symbol;
 	void (*arrange)(Monitor *);
@@ -168,13 +246,20 @@ struct Monitor {
 	unsigned int tagset[2];
 	int showbar;
 	int topbar;
-	Client *clients;
+	unsigned int dirty;   /* work pending for commit() */
+	unsigned int occ, urg; /* tags holding clients, urgent clients; see tagcount() */
+	Client *clients, *clientstail;
 	Client *sel;
-	Client *stack;
+	Client *stack, *stacktail;
 	Monitor *next;
 	Window barwin;
 	const Layout *lt[2];
 	Pertag *pertag;
+	Window *stacking;     /* order last pushed by restack() */
+	int nstacking;
+	Client **vis, **xvis, **tiled; /* visible, visible minus all-tags, tiled */
+	int nvis, nxvis, ntiled, viscap;
+	int visvalid;         /* arrays above match clients, see updatevis() */
 };
 
 typedef struct {
@@ -195,66 +280,158 @@ struct Systray {
 	Client *icons;
 };
 
+typedef struct Watch Watch;
+struct Watch {
+	int fd;
+	int istimer;
+	void (*func)(Watch *w);
+	void *arg;
+};
+
+typedef struct {
+	Window win;
+	int kind;             /* Win* */
+	void *p;              /* the Client, its swallower, or the Monitor */
+} WinRec;
+
+typedef struct {
+	xcb_get_window_attributes_cookie_t attrs;
+	xcb_get_geometry_cookie_t geom;
+	xcb_get_property_cookie_t prop[PfLast];
+	xcb_get_property_reply_t *reply[PfLast];
+	unsigned int have;    /* 1 << Pf* for each reply already taken */
+} Prefetch;
+
+/* Aho-Corasick automaton over one Rule field, see compilerules() */
+typedef struct {
+	int child, sibling;   /* trie edges */
+	int fail, dict;       /* failure link, next pattern end on its chain */
+	int pat;              /* pattern ending here or -1 */
+	unsigned char ch;
+} ACNode;
+
+typedef struct {
+	ACNode *node;
+	int nnodes, cap, npats;
+	int *first;           /* per pattern: first rule using it */
+	unsigned int *seen;   /* per pattern: stamp of the last scan matching it */
+	unsigned int stamp;
+	int *hits, nhits;     /* patterns matched by the last scan */
+} Matcher;
+
+typedef struct {
+	int pat[RuleLast];    /* pattern id of class, instance, title or -1 */
+	int next[RuleLast];   /* next rule sharing that pattern */
+} RuleKey;
+
+typedef struct RuleMemo RuleMemo;
+struct RuleMemo {
+	RuleMemo *next;
+	char *class, *instance;
+	int n;
+	int rules[];          /* rules passing class and instance, in order */
+};
+
 enum placement_style { centered, under_mouse, };
 extern enum placement_style placement_style; 
 
 /* function declarations */
-static void applyrules(Client *c);
+static Watch *addtimer(void (*func)(Watch *w), void *arg);
+static Watch *addwatch(int fd, void (*func)(Watch *w), void *arg);
+static int acadd(Matcher *m, const char *s);
+static void acbuild(Matcher *m);
+static int acchild(Matcher *m, int n, unsigned char ch);
+static int acnode(Matcher *m, int parent, unsigned char ch);
+static void acscan(Matcher *m, const char *s);
+static void applyrules(Client *c, const char *class, const char *instance);
 static int applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact);
-static void arrange(Monitor *m);
 static void arrangemon(Monitor *m);
 static void attach(Client *c);
+static void attachafter(Client *c, Client *after);
 static void attachstack(Client *c);
-static Bool atompropop(Window w, Atom prop, Atom value, int op);
 static void buttonpress(XEvent *e);
 static void checkotherwm(void);
+#ifdef LISTDEBUG
+static void checklists(void);
+static const char *checkmon(Monitor *m);
+#endif
 static void cleanup(void);
 static void cleanupmon(Monitor *mon);
+static void cleanuprules(void);
+static int clientlayer(Client *c);
 static void clientmessage(XEvent *e);
+static int cmpint(const void *a, const void *b);
+static int cmpkeysym(const void *a, const void *b);
+static void coalesce(XEvent *ev, int n);
+static void compilerules(void);
+static void commit(void);
 static void configure(Client *c);
 static void configurenotify(XEvent *e);
 static void configurerequest(XEvent *e);
 static Monitor *createmon(void);
+static void defer(unsigned int work);
+static void defertags(Client *c);
+static void delwatch(Watch *w);
 static void destroynotify(XEvent *e);
 static void detach(Client *c);
 static void detachstack(Client *c);
 static Monitor *dirtomon(int dir);
+static void dispatch(XEvent *ev, int n);
 static void drawbar(Monitor *m);
-static void drawbars(void);
+static void dropprefetch(Prefetch *pf);
+static void droprulememos(void);
+static void dropstacking(void);
 static void enternotify(XEvent *e);
 static void expose(XEvent *e);
+static Bool fetchattrs(Prefetch *pf, XWindowAttributes *wa);
 static Client *findbefore(Client *c);
 static void window_opacity_set(Client *c, double opacity);
+static void flushnetstate(Client *c);
 static void focus(Client *c);
 static void focusclienttaskbar(const Arg *arg);
 static void focusin(XEvent *e);
 static void focusmon(const Arg *arg);
 static void focusstack(const Arg *arg);
+static void freeclient(Client *c);
 static Atom getatomprop(Client *c, Atom prop);
 static Client *getclientundermouse(void);
 static int getcardprop(Client *c, Atom prop);
 static pid_t getparentprocess(pid_t p);
 static int getrootptr(int *x, int *y);
-static long getstate(Window w);
 static unsigned int getsystraywidth();
 static int gettextprop(Window w, Atom atom, char *text, unsigned int size);
 static void grabbuttons(Client *c, int focused);
 static void grabkeys(void);
 static void icccm2_setup(int replace_wm);
+static void idle(Watch *w);
 static void incnmaster(const Arg *arg);
 static void incnstackcols(const Arg *arg);
 static int isdescprocess(pid_t p, pid_t c);
 static void keypress(XEvent *e);
 static void killclient(const Arg *arg);
-static void manage(Window w, XWindowAttributes *wa);
+static void manage(Window w, XWindowAttributes *wa, Prefetch *pf);
+static void markurgent(Client *c, int urg);
 static void mappingnotify(XEvent *e);
 static void maprequest(XEvent *e);
 static void monocle(Monitor *m);
 static void motionnotify(XEvent *e);
 static void movemouse(const Arg *arg);
+static void mrulink(Client *c);
+static Client *mrutop(Monitor *m, unsigned int avoid);
+static void mruunlink(Client *c);
+static Client *newclient(void);
+static Bool netstateop(Client *c, Atom a, int mode);
 static Client *nexttiled(Client *c);
 static void pop(Client *c);
+static unsigned int protobit(Atom a);
+static void prefetch(Prefetch *pf, Window w);
+static xcb_get_property_reply_t *prefetched(Prefetch *pf, int i);
 static void propertynotify(XEvent *e);
+static int propsizehints(xcb_get_property_reply_t *r, XSizeHints *size);
+static int proptext(xcb_get_property_reply_t *r, char *text, unsigned int size);
+static void *propvalue(xcb_get_property_reply_t *r, Atom type, int format, unsigned int n);
+static int propwmhints(xcb_get_property_reply_t *r, XWMHints *wmh);
+static void publishlist(Atom prop, Window **pub, int *npub, Window *w, int n);
 static void pushstack(const Arg *arg);
 static void quit(const Arg *arg);
 static Monitor *recttomon(int x, int y, int w, int h);
@@ -265,31 +442,42 @@ static void resizeclient(Client *c, int x, int y, int w, int h);
 static void resizemouse(const Arg *arg);
 static void resizerequest(XEvent *e);
 static void restack(Monitor *m);
+static RuleMemo *rulememo(const char *class, const char *instance);
 static void run(void);
 static void scan(void);
 static void selectionclear(XEvent *e);
-static int sendevent(Window w, Atom proto, int m, long d0, long d1, long d2, long d3, long d4);
+static int sendevent(Window w, Atom type, int m, long d0, long d1, long d2, long d3, long d4);
+static int sendprotocol(Client *c, Atom proto, long time);
 static void sendmon(Client *c, Monitor *m);
 static void set_net_current_desktop();
+static void setactivewindow(Window w);
+static void setborder(Client *c, unsigned long pixel);
 static void setclientstate(Client *c, long state);
+static void setdesktopprop(Client *c, long desktop);
+static void setdirty(Monitor *m, unsigned int bits);
 static void setfocus(Client *c);
 static void setfullscreen(Client *c, int fullscreen);
 static void setlayout(const Arg *arg);
 //static void setmfact(const Arg *arg);
-static void settagsprop(Window w, unsigned int tags);
+static void setsizehints(Client *c, XSizeHints *size);
+static void settagsprop(Client *c, unsigned int tags);
+static void settimer(Watch *w, unsigned int ms, unsigned int interval);
 static void setup(void);
 static void seturgent(Client *c, int urg);
+static void setwindowtype(Client *c, Atom state, Atom wtype);
+static void setwmhints(Client *c, XWMHints *wmh);
 static void showhide(Client *c);
-#ifndef HAVE_USE_SIGACTION_SIGCHLD
-static void sigchld(int unused);
-#endif
+static void sigchld(Watch *w);
 static void spawn(const Arg *arg);
+static int stackabove(Client *a, Client *b);
 static int stackpos(const Arg *arg, int exludetaggedall);
 static Client *swallowingclient(Window w);
 static Monitor *systraytomon(Monitor *m);
 static void tag(const Arg *arg);
+static void tagcount(Client *c, int d);
 static void tagmon(const Arg *arg);
 static Client *termforwin(const Client *c);
+static int textpropcpy(XTextProperty *name, char *text, unsigned int size);
 static void tile(Monitor *m);
 static void togglebar(const Arg *arg);
 static void togglelosefocus(const Arg *arg);
@@ -302,24 +490,32 @@ static void unmapnotify(XEvent *e);
 static void updatebarpos(Monitor *m);
 static void updatebars(void);
 static void updateclientlist(void);
+static void updatestackinglist(void);
+static void updatedesktopnames(void);
 static int updategeom(void);
 static void updatenumlockmask(void);
+static void updateprotocols(Client *c);
 static void updatesizehints(Client *c);
 static void updatestatus(void);
 static void updatesystray(void);
 static void updatesystrayicongeom(Client *i, int w, int h);
 static void updatesystrayiconstate(Client *i, XPropertyEvent *ev);
 static void updatetitle(Client *c);
+static void updatevis(Monitor *m);
 static void updatewindowtype(Client *c);
 static void updatewmhints(Client *c);
 static void unswallow_now(const Arg *arg);
 static void view(const Arg *arg);
+static void windel(Window w);
+static WinRec *winfind(Window w);
+static unsigned int winhash(Window w);
+static void winset(Window w, int kind, void *p);
 static Client *wintoclient(Window w);
 static Monitor *wintomon(Window w);
 static Client *wintosystrayicon(Window w);
 static int xerror(Display *dpy, XErrorEvent *ee);
-static int xerrordummy(Display *dpy, XErrorEvent *ee);
 static int xerrorstart(Display *dpy, XErrorEvent *ee);
+static void xignore(unsigned long first);
 static void xinitvisual();
 static void WARP(const Client *c);
 static void zoom(const Arg *arg);
@@ -331,6 +527,24 @@ static void setfacts(const Arg *arg);
 /* variables */
 static Systray *systray = NULL;
 static Client *prevzoom = NULL;
+static unsigned long raiseseq = 0;
+static unsigned long stackseq = 0;
+static Client *urgent, *urgenttail; /* urgent clients, oldest first */
+static Shadow rootsh;         /* root window properties, see Shadow */
+static Window *clientlist, *stackinglist; /* as last published on root */
+static int nclientlist, nstackinglist;
+static unsigned long suppressed; /* writes SHADOWED() found redundant */
+static WinRec *wintab;        /* open addressing index of our windows */
+static Pool clientpool = { sizeof(Client) }, infopool = { sizeof(Clientinfo) };
+static Matcher matcher[RuleLast];
+static KeyBind *keybinds;    /* keys[] by keycode, see grabkeys() */
+static int nkeybinds, keyfirst[256], keycount[256];
+static int *keyorder;        /* keys[] indices sorted by keysym */
+static RuleKey *rulekeys;
+static int *rulehits, *rulecand, *openrules, nopenrules; /* openrules: no class or instance */
+static RuleMemo *rulememos[64];
+static int nrulememos;
+static unsigned int wintabsz, wintabn;
 static const char broken[] = "broken";
 static char stext[256];
 static int screen;
@@ -358,11 +572,27 @@ static void (*handler[LASTEvent]) (XEvent *) = {
 	[SelectionClear] = selectionclear,
 	[UnmapNotify] = unmapnotify
 };
+/* everything else, input included, keeps its place in the queue: a key
+ * or map must not overtake the unmaps and crossings queued ahead of it */
+static const unsigned char prio[LASTEvent] = {
+	[Expose] = PrioCosmetic,
+	[PropertyNotify] = PrioCosmetic,
+};
 static Atom wmatom[WMLast], netatom[NetLast], xatom[XLast], dwmatom[DWMLast];
+static Atom utf8string;
+static struct {
+	unsigned long first, last;
+} ignores[32];                /* request serials whose errors xerror() drops */
+static unsigned int ignorenext;
 static int running = 1;
+static int scanning = 0;      /* scan() is adopting existing windows */
+static int epfd = -1;         /* epoll instance driving run() */
+static Watch *xwatch, *sigwatch, *idletimer;
+static unsigned int idlework;  /* Idle* bits pending for idle() */
 static Cur *cursor[CurLast];
 static Clr **scheme;
 static Display *dpy;
+static xcb_connection_t *xc; /* dpy's XCB side, for pipelined requests */
 static Drw *drw;
 static Monitor *mons, *selmon;
 static Window root, wmcheckwin;
@@ -386,47 +616,172 @@ struct Pertag {
 	const Layout *ltidxs[LENGTH(tags) + 1][2]; /* matrix of tags and layouts indexes  */
 	Bool showbars[LENGTH(tags) + 1]; /* display bar for the current tag */
 	Client *prevzooms[LENGTH(tags) + 1]; /* store zoom information */
+	int nclients[LENGTH(tags)]; /* clients on each tag, all-tags ones excluded */
+	int nurgent[LENGTH(tags)]; /* urgent clients on each tag */
+	Client *mru[LENGTH(tags)]; /* stack members on each tag, most recent first */
 };
 
 /* compile-time check if all tags fit into an unsigned int bit array. */
-struct NumTags { char limitexceeded[LENGTH(tags) > 31 ? -1 : 1]; };
+struct NumTags { char limitexceeded[LENGTH(tags) > MAXTAGS ? -1 : 1]; };
 
 /* function implementations */
+/* add pattern s to m's trie, returns its pattern id; equal patterns share one */
+int
+acadd(Matcher *m, const char *s)
+{
+	int n, c;
+
+	if (!m->nnodes)
+		acnode(m, -1, 0);
+	for (n = 0; *s; s++, n = c)
+		if ((c = acchild(m, n, *s)) < 0)
+			c = acnode(m, n, *s);
+	if (m->node[n].pat < 0)
+		m->node[n].pat = m->npats++;
+	return m->node[n].pat;
+}
+
+/* compute failure links breadth first once all patterns are in */
 void
-applyrules(Client *c)
+acbuild(Matcher *m)
 {
-	const char *class, *instance;
-	unsigned int i;
+	int *queue, head = 0, tail = 0, u, v, f, g;
+
+	if (!m->nnodes)
+		acnode(m, -1, 0);
+	queue = ecalloc(m->nnodes, sizeof(int));
+	for (v = m->node[0].child; v >= 0; v = m->node[v].sibling)
+		queue[tail++] = v;
+	while (head < tail) {
+		u = queue[head++];
+		for (v = m->node[u].child; v >= 0; v = m->node[v].sibling) {
+			for (f = m->node[u].fail; f && acchild(m, f, m->node[v].ch) < 0; f = m->node[f].fail);
+			g = acchild(m, f, m->node[v].ch);
+			f = m->node[v].fail = g >= 0 ? g : 0;
+			m->node[v].dict = f && m->node[f].pat >= 0 ? f : m->node[f].dict;
+			queue[tail++] = v;
+		}
+	}
+	free(queue);
+	m->first = ecalloc(m->npats + 1, sizeof(int));
+	m->seen = ecalloc(m->npats + 1, sizeof(unsigned int));
+	m->hits = ecalloc(m->npats + 1, sizeof(int));
+	for (u = 0; u < m->npats; u++)
+		m->first[u] = -1;
+}
+
+int
+acchild(Matcher *m, int n, unsigned char ch)
+{
+	for (n = m->node[n].child; n >= 0 && m->node[n].ch != ch; n = m->node[n].sibling);
+	return n;
+}
+
+int
+acnode(Matcher *m, int parent, unsigned char ch)
+{
+	ACNode *n;
+
+	if (m->nnodes == m->cap) {
+		m->cap = m->cap ? 2 * m->cap : 64;
+		if (!(m->node = realloc(m->node, m->cap * sizeof(ACNode))))
+			die("fatal: could not malloc() %zu bytes\n", m->cap * sizeof(ACNode));
+	}
+	n = &m->node[m->nnodes];
+	n->ch = ch;
+	n->child = -1;
+	n->fail = n->dict = 0;
+	n->pat = -1;
+	n->sibling = parent >= 0 ? m->node[parent].child : -1;
+	if (parent >= 0)
+		m->node[parent].child = m->nnodes;
+	return m->nnodes++;
+}
+
+/* one pass over s collects every pattern occurring in it into m->hits */
+void
+acscan(Matcher *m, const char *s)
+{
+	int n = 0, t, c;
+
+	m->stamp++;
+	m->nhits = 0;
+	if ((t = m->node[0].pat) >= 0) { /* the empty pattern is in every string */
+		m->seen[t] = m->stamp;
+		m->hits[m->nhits++] = t;
+	}
+	for (; *s; s++) {
+		while ((c = acchild(m, n, *s)) < 0 && n)
+			n = m->node[n].fail;
+		n = c >= 0 ? c : 0;
+		for (t = m->node[n].pat >= 0 ? n : m->node[n].dict; t; t = m->node[t].dict)
+			if (m->seen[m->node[t].pat] != m->stamp) {
+				m->seen[m->node[t].pat] = m->stamp;
+				m->hits[m->nhits++] = m->node[t].pat;
+			}
+	}
+}
+
+Watch *
+addtimer(void (*func)(Watch *w), void *arg)
+{
+	Watch *w;
+	int fd;
+
+	if ((fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+		die("timerfd_create:");
+	w = addwatch(fd, func, arg);
+	w->istimer = 1;
+	return w;
+}
+
+Watch *
+addwatch(int fd, void (*func)(Watch *w), void *arg)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+	Watch *w;
+
+	w = ecalloc(1, sizeof(Watch));
+	w->fd = fd;
+	w->func = func;
+	w->arg = arg;
+	ev.data.ptr = w;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		die("epoll_ctl:");
+	return w;
+}
+
+void
+applyrules(Client *c, const char *class, const char *instance)
+{
+	int i, titled = 0;
 	const Rule *r;
 	Monitor *m;
-	XClassHint ch = { NULL, NULL };
+	RuleMemo *rm;
 
 	/* rule matching */
 	c->isfloating = 0;
 	c->tags = 0;
-	XGetClassHint(dpy, c->win, &ch);
-	class    = ch.res_class ? ch.res_class : broken;
-	instance = ch.res_name  ? ch.res_name  : broken;
-
-	for (i = 0; i < LENGTH(rules); i++) {
-		r = &rules[i];
-		if ((!r->title || strstr(c->name, r->title))
-		&& (!r->class || strstr(class, r->class))
-		&& (!r->instance || strstr(instance, r->instance)))
-		{
-			c->isterminal = r->isterminal;
-			c->isfloating = r->isfloating;
-			c->opacity = r->opacity;
-			c->tags |= r->tags;
-			for (m = mons; m && m->num != r->monitor; m = m->next);
-			if (m)
-				c->mon = m;
+	rm = rulememo(class, instance);
+	for (i = 0; i < rm->n; i++) {
+		r = &rules[rm->rules[i]];
+		if (r->title) {
+			if (!titled++)
+				acscan(&matcher[RuleTitle], c->ci->name);
+			if (matcher[RuleTitle].seen[rulekeys[rm->rules[i]].pat[RuleTitle]]
+			    != matcher[RuleTitle].stamp)
+				continue;
 		}
+		c->ci->isterminal = r->isterminal;
+		c->isfloating = r->isfloating;
+		c->ci->opacity = r->opacity;
+		c->tags |= r->tags;
+		if (r->monitor < 0)
+			continue;
+		for (m = mons; m && m->num != r->monitor; m = m->next);
+		if (m)
+			c->mon = m;
 	}
-	if (ch.res_class)
-		XFree(ch.res_class);
-	if (ch.res_name)
-		XFree(ch.res_name);
 	c->tags = c->tags & TAGMASK ? c->tags & TAGMASK : c->mon->tagset[c->mon->seltags];
 }
 
@@ -468,55 +823,41 @@ applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact)
 	if (*w < bh && *h != 1 && *w != 1)
 		*w = bh;
 	if (resizehints || c->isfloating || !c->mon->lt[c->mon->sellt]->arrange) {
-		if (!c->hintsvalid)
+		if (!c->ci->hintsvalid)
 			updatesizehints(c);
 		/* see last two sentences in ICCCM 4.1.2.3 */
-		baseismin = c->basew == c->minw && c->baseh == c->minh;
+		baseismin = c->ci->basew == c->ci->minw && c->ci->baseh == c->ci->minh;
 		if (!baseismin) { /* temporarily remove base dimensions */
-			*w -= c->basew;
-			*h -= c->baseh;
+			*w -= c->ci->basew;
+			*h -= c->ci->baseh;
 		}
 		/* adjust for aspect limits */
-		if (c->mina > 0 && c->maxa > 0) {
-			if (c->maxa < (float)*w / *h)
-				*w = *h * c->maxa + 0.5;
-			else if (c->mina < (float)*h / *w)
-				*h = *w * c->mina + 0.5;
+		if (c->ci->mina > 0 && c->ci->maxa > 0) {
+			if (c->ci->maxa < (float)*w / *h)
+				*w = *h * c->ci->maxa + 0.5;
+			else if (c->ci->mina < (float)*h / *w)
+				*h = *w * c->ci->mina + 0.5;
 		}
 		if (baseismin) { /* increment calculation requires this */
-			*w -= c->basew;
-			*h -= c->baseh;
+			*w -= c->ci->basew;
+			*h -= c->ci->baseh;
 		}
 		/* adjust for increment value */
-		if (c->incw)
-			*w -= *w % c->incw;
-		if (c->inch)
-			*h -= *h % c->inch;
+		if (c->ci->incw)
+			*w -= *w % c->ci->incw;
+		if (c->ci->inch)
+			*h -= *h % c->ci->inch;
 		/* restore base dimensions */
-		*w = MAX(*w + c->basew, c->minw);
-		*h = MAX(*h + c->baseh, c->minh);
-		if (c->maxw)
-			*w = MIN(*w, c->maxw);
-		if (c->maxh)
-			*h = MIN(*h, c->maxh);
+		*w = MAX(*w + c->ci->basew, c->ci->minw);
+		*h = MAX(*h + c->ci->baseh, c->ci->minh);
+		if (c->ci->maxw)
+			*w = MIN(*w, c->ci->maxw);
+		if (c->ci->maxh)
+			*h = MIN(*h, c->ci->maxh);
 	}
 	return *x != c->x || *y != c->y || *w != c->w || *h != c->h;
 }
 
-void
-arrange(Monitor *m)
-{
-	if (m)
-		showhide(m->stack);
-	else for (m = mons; m; m = m->next)
-		showhide(m->stack);
-	if (m) {
-		arrangemon(m);
-		restack(m);
-	} else for (m = mons; m; m = m->next)
-		arrangemon(m);
-}
-
 void
 arrangemon(Monitor *m)
 {
@@ -528,171 +869,145 @@ arrangemon(Monitor *m)
 void
 attach(Client *c)
 {
+	if (c->inclients) {
+		fprintf(stderr, "FIXME: attach: %lu already in the client list\n", c->win);
+		return;
+	}
+	c->inclients = 1;
+	c->prev = NULL;
 	c->next = c->mon->clients;
+	if (c->next)
+		c->next->prev = c;
+	else
+		c->mon->clientstail = c;
 	c->mon->clients = c;
+	c->mon->visvalid = 0;
+	tagcount(c, 1);
 }
 
- void
+/* insert c right after 'after', which must be in c->mon's client list */
+void
+attachafter(Client *c, Client *after)
+{
+	if (c->inclients || !after->inclients) {
+		fprintf(stderr, "FIXME: attachafter: bad membership %lu after %lu\n",
+			c->win, after->win);
+		return;
+	}
+	c->inclients = 1;
+	c->prev = after;
+	c->next = after->next;
+	if (c->next)
+		c->next->prev = c;
+	else
+		c->mon->clientstail = c;
+	after->next = c;
+	c->mon->visvalid = 0;
+	tagcount(c, 1);
+}
+
+void
 attachbottom(Client *c)
 {
-	Client **tc;
+	if (c->inclients) {
+		fprintf(stderr, "FIXME: attachbottom: %lu already in the client list\n", c->win);
+		return;
+	}
+	c->inclients = 1;
 	c->next = NULL;
-	for (tc = &c->mon->clients; *tc; tc = &(*tc)->next);
-	*tc = c;
+	c->prev = c->mon->clientstail;
+	if (c->prev)
+		c->prev->next = c;
+	else
+		c->mon->clients = c;
+	c->mon->clientstail = c;
+	c->mon->visvalid = 0;
+	tagcount(c, 1);
 }
 
 void
 attachstack(Client *c)
 {
-	{ //madhu 131023 - TODO FIGURE OUT HOW TO PRINT A STACKBACKTRACE HERE
-		Client **tc;
-		int count = 0, maxcount = 1000;
-		for (tc=&c->mon->stack; *tc
-			    && *tc != c
-			    && ((count == 0)?1:(*tc != c->mon->stack))
-			    && (count <= maxcount);
-		    tc=&(*tc)->snext,count++);
-		if (count > maxcount || (*tc && *tc == c->mon->stack)) {
-			fprintf(stderr, "FIXME: attachstack infinite loop\n");
-			*tc = NULL;
-			return;
-		}
-		if (*tc == c) {
-			fprintf(stderr, "FIXME: attachstack corruption dup\n");
-			return;
-		}
+	if (c->instack) {
+		fprintf(stderr, "FIXME: attachstack corruption dup\n");
+		return;
 	}
+	c->instack = 1;
+	c->sprev = NULL;
 	c->snext = c->mon->stack;
+	if (c->snext)
+		c->snext->sprev = c;
+	else
+		c->mon->stacktail = c;
 	c->mon->stack = c;
-}
-
-/* mode = 0: has, mode=1, add, mode=2 delete.
-get mode=3 - val is the index of the property to retrieve
-*/
-Bool
-atompropop(Window w, Atom prop, Atom value, int mode)
-{
-
-	Atom realtype;
-	unsigned long n, extra;
-	int format, i = 0;
-	Atom *p;
-
-	if (XGetWindowProperty(dpy, w, prop, 0L, 64L, False, XA_ATOM,
-			       &realtype, &format, &n, &extra,
-			       (unsigned char **)&p)
-	    != Success)
-		return False;
-
-	if  (p == NULL)
-		if (mode == 0 || mode == 2) {
-			return False;
-		}
-
-	if (n == 0) {
-		if (mode == 0 || mode == 2 || mode == 3) {
-			XFree(p);
-			return False;
-		}
-	}
-
-	if (mode == 3) {
-		Atom ret = (value < n) ? p[value] : False;
-		XFree(p);
-		return ret;
-	}
-
-	int found = 0;
-	for (i = 0; i < n; i++)
-		if (value == p[i]) {
-			found++;
-			if (mode == 0) {
-				XFree(p);
-				return True;
-			}
-		}
-	if (mode == 0) {
-		XFree(p);
-		return found ? True : False;
-	}
-
-	if (mode == 2 && !found) {
-		XFree(p);
-		return True;
-	}
-
-	if (mode == 1 && found) {
-		XFree(p);
-		return True;
-	}
-
-	int newsize = (mode == 1) ? 1 + n : n - found;
-
-	Atom *ret;
-	if (!(ret = (Atom *)calloc(newsize, sizeof(Atom))))
-		if (! (mode == 2 && newsize == 0))
-			die("fatal: could not malloc() %u bytes\n",
-			    sizeof(Atom) * newsize);
-	int j = 0;
-	for (i = 0; i < n; i++) {
-		if (mode == 1 || (mode == 2 && p[i] != value))
-			ret[j++] = p[i];
-	}
-
-	if (mode == 1)
-		ret[j++] = value;
-	if (j != newsize) die("assert");
-
-
-	Bool retval = XChangeProperty(dpy, w, prop, XA_ATOM, 32,
-				      PropModeReplace,
-				      (unsigned char *)ret, j);
-	if (mode == 1 && newsize == 1)
-		if (! (ret[0] == value))
-			die("wtf");
-	if (ret) free(ret);
-	XFree(p);
-	return retval;
+	c->focused = ++stackseq;
+	mrulink(c);
+	defer(IdleStacking);
 }
 
 void
 swallow(Client *p, Client *c)
 {
-	if (c->noswallow || c->isterminal)
+	if (c->ci->noswallow || c->ci->isterminal)
 		return;
 
+	markurgent(c, 0);
 	detach(c);
 	detachstack(c);
 
 	setclientstate(c, WithdrawnState);
 	XUnmapWindow(dpy, p->win);
 
-	p->swallowing = c;
+	p->ci->swallowing = c;
 	c->mon = p->mon;
 
 	Window w = p->win;
+	Shadow sh = p->ci->sh;
+	unsigned int protocols = p->ci->protocols;
+	XWMHints wmh = p->ci->wmh;
+	int haswmh = p->ci->haswmh;
 	p->win = c->win;
 	c->win = w;
+	p->ci->sh = c->ci->sh;
+	c->ci->sh = sh;
+	p->ci->protocols = c->ci->protocols;
+	c->ci->protocols = protocols;
+	p->ci->wmh = c->ci->wmh;
+	c->ci->wmh = wmh;
+	p->ci->haswmh = c->ci->haswmh;
+	c->ci->haswmh = haswmh;
+	p->hidden = c->hidden = -1;
+	winset(p->win, WinClient, p);
+	winset(c->win, WinSwallowed, p);
 	updatetitle(p);
-	arrange(p->mon);
+	setdirty(p->mon, DirtyArrange);
 	configure(p);
-	updateclientlist();
+	defertags(p);
+	defer(IdleClientList);
 }
 
 void
 unswallow(Client *c)
 {
-	c->win = c->swallowing->win;
+	windel(c->win);
+	c->win = c->ci->swallowing->win;
+	c->ci->sh = c->ci->swallowing->ci->sh;
+	c->ci->protocols = c->ci->swallowing->ci->protocols;
+	c->ci->wmh = c->ci->swallowing->ci->wmh;
+	c->ci->haswmh = c->ci->swallowing->ci->haswmh;
+	winset(c->win, WinClient, c);
 
-	free(c->swallowing);	// ;madhu 231223 free? rly?
-	c->swallowing = NULL;
+	freeclient(c->ci->swallowing);	// ;madhu 231223 free? rly?
+	c->ci->swallowing = NULL;
 
 	updatetitle(c);
-	arrange(c->mon);
+	setdirty(c->mon, DirtyArrange);
 	XMapWindow(dpy, c->win);
 	XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
+	c->hidden = 0;
 	configure(c);
 	setclientstate(c, NormalState);
+	defer(IdleClientList|IdleStacking);
 }
 
 void
@@ -700,17 +1015,32 @@ unswallow_now(const Arg *arg)
 {
 	Client *c = selmon->sel;
 	if (!c) return;
-	if (!c->swallowing) {
+	if (!c->ci->swallowing) {
 		Client *term = termforwin(c);
 		if (term)
 			swallow(term, c);
 		return;
 	}
 	Window w = c->win;
-	Client *d = c->swallowing;
-	c->win = c->swallowing->win;
-	c->swallowing = NULL;
+	Shadow sh = c->ci->sh;
+	unsigned int protocols = c->ci->protocols;
+	XWMHints wmh = c->ci->wmh;
+	int haswmh = c->ci->haswmh;
+	Client *d = c->ci->swallowing;
+	c->win = c->ci->swallowing->win;
+	c->ci->sh = d->ci->sh;
+	c->ci->swallowing = NULL;
 	d->win = w;
+	d->ci->sh = sh;
+	c->ci->protocols = d->ci->protocols;
+	d->ci->protocols = protocols;
+	c->ci->wmh = d->ci->wmh;
+	d->ci->wmh = wmh;
+	c->ci->haswmh = d->ci->haswmh;
+	d->ci->haswmh = haswmh;
+	c->hidden = d->hidden = -1;
+	winset(c->win, WinClient, c);
+	winset(d->win, WinClient, d);
 	if (!(d->mon == c->mon)) die("assert");
 	updatetitle(d);
 	updatetitle(c);
@@ -718,9 +1048,10 @@ unswallow_now(const Arg *arg)
 	attachstack(d);
 	setclientstate(c, NormalState);
 	setclientstate(d, NormalState);
-	arrange(c->mon);
+	setdirty(c->mon, DirtyArrange);
 	XMapWindow(dpy, c->win);
 	XMapWindow(dpy, d->win);
+	defer(IdleClientList);
 }
 
 void
@@ -754,10 +1085,8 @@ buttonpress(XEvent *e)
 			click = ClkStatusText;
 		else {
 			click = ClkWinTitle;
-			for (c = selmon->clients; c; c = c->next)
-				if (ISVISIBLE(c))
-					n++;
-			if (n == 0)
+			updatevis(selmon);
+			if ((n = selmon->nvis) == 0)
 				ncc = 0;
 			else {
 				int blw = TEXTW(m->ltsymbol);
@@ -787,6 +1116,78 @@ checkotherwm(void)
 	XSync(dpy, False);
 }
 
+#ifdef LISTDEBUG
+const char *
+checkmon(Monitor *m)
+{
+	Client *c, *p;
+	int i, n, ns, occ[MAXTAGS] = { 0 }, urg[MAXTAGS] = { 0 };
+
+	for (n = 0, p = NULL, c = m->clients; c; p = c, c = c->next, n++) {
+		if (n > 1 << 16)
+			return "client list cycle";
+		if (c->prev != p)
+			return "client list prev link";
+		if (!c->inclients || !c->instack)
+			return "client list member not flagged in both lists";
+		if (c->mon != m)
+			return "client list member on another monitor";
+		for (i = 0; i < LENGTH(tags); i++) {
+			occ[i] += c->tags & 1 << i && c->tags != TAGMASK;
+			urg[i] += c->tags & 1 << i && c->isurgent;
+		}
+	}
+	if (m->clientstail != p)
+		return "client list tail";
+	for (ns = 0, p = NULL, c = m->stack; c; p = c, c = c->snext, ns++) {
+		if (ns > n)
+			return "focus stack longer than the client list";
+		if (c->sprev != p)
+			return "focus stack prev link";
+		if (!c->instack || !c->inclients || c->mon != m)
+			return "focus stack member not in the client list";
+	}
+	if (m->stacktail != p)
+		return "focus stack tail";
+	if (ns != n)
+		return "focus stack shorter than the client list";
+	if (m->sel && (!m->sel->instack || m->sel->mon != m))
+		return "selected client not on the focus stack";
+	for (i = 0; i < LENGTH(tags); i++) {
+		if (occ[i] != m->pertag->nclients[i] || !occ[i] != !(m->occ & 1 << i))
+			return "per-tag client count";
+		if (urg[i] != m->pertag->nurgent[i] || !urg[i] != !(m->urg & 1 << i))
+			return "per-tag urgency count";
+	}
+	return NULL;
+}
+
+/* debug builds check both lists of every monitor after each batch and
+ * dump them the first time an invariant breaks */
+void
+checklists(void)
+{
+	static int reported;
+	const char *err;
+	Monitor *m;
+	Client *c;
+	int n;
+
+	for (m = mons; m; m = m->next)
+		if (!reported && (err = checkmon(m))) {
+			reported = 1;
+			fprintf(stderr, "dwm: checklists: monitor %d: %s\n", m->num, err);
+			for (c = m->clients, n = 0; c && n < 64; c = c->next, n++)
+				fprintf(stderr, "  client %p win 0x%lx prev %p tags 0x%x lists %d%d %s\n",
+					(void *)c, c->win, (void *)c->prev, c->tags,
+					c->inclients, c->instack, c->ci->name);
+			for (c = m->stack, n = 0; c && n < 64; c = c->snext, n++)
+				fprintf(stderr, "  stack  %p win 0x%lx sprev %p\n",
+					(void *)c, c->win, (void *)c->sprev);
+		}
+}
+#endif
+
 void
 cleanup(void)
 {
@@ -794,12 +1195,15 @@ cleanup(void)
 	Layout foo = { "", NULL };
 	Monitor *m;
 	size_t i;
+	int sigfd;
 
 	view(&a);
+	commit();
 	selmon->lt[selmon->sellt] = &foo;
 	for (m = mons; m; m = m->next)
 		while (m->stack)
 			unmanage(m->stack, 0);
+	idle(NULL);
 	XUngrabKey(dpy, AnyKey, AnyModifier, root);
 	while (mons)
 		cleanupmon(mons);
@@ -823,6 +1227,32 @@ cleanup(void)
 	XSync(dpy, False);
 	XSetInputFocus(dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
 	XDeleteProperty(dpy, root, netatom[NetActiveWindow]);
+	free(wintab);
+	cleanuprules();
+	free(clientlist);
+	free(stackinglist);
+	free(keybinds);
+	free(keyorder);
+#ifdef POOLDEBUG
+	{
+		size_t inuse, total, nslabs;
+
+		poolstats(&clientpool, &inuse, &total, &nslabs);
+		fprintf(stderr, "dwm: %zu of %zu client records in use, %zu slabs\n",
+			inuse, total, nslabs);
+	}
+#endif
+#ifdef SHADOWDEBUG
+	fprintf(stderr, "dwm: %lu redundant requests suppressed\n", suppressed);
+#endif
+	pooldestroy(&clientpool);
+	pooldestroy(&infopool);
+	delwatch(idletimer);
+	sigfd = sigwatch->fd;
+	delwatch(sigwatch); /* leaves the signalfd open */
+	close(sigfd);
+	delwatch(xwatch);
+	close(epfd);
 }
 
 void
@@ -836,11 +1266,44 @@ cleanupmon(Monitor *mon)
 		for (m = mons; m && m->next != mon; m = m->next);
 		m->next = mon->next;
 	}
+	windel(mon->barwin);
 	XUnmapWindow(dpy, mon->barwin);
 	XDestroyWindow(dpy, mon->barwin);
+	free(mon->stacking);
+	free(mon->vis);
 	free(mon);
 }
 
+void
+cleanuprules(void)
+{
+	int f;
+
+	droprulememos();
+	for (f = 0; f < RuleLast; f++) {
+		free(matcher[f].node);
+		free(matcher[f].first);
+		free(matcher[f].seen);
+		free(matcher[f].hits);
+	}
+	free(rulekeys);
+	free(rulehits);
+	free(rulecand);
+	free(openrules);
+}
+
+int
+clientlayer(Client *c)
+{
+	if (c->isdesktop)
+		return LayerDesktop;
+	if (c->isfullscreen)
+		return LayerFullscreen;
+	if (c->isfloating || !c->mon->lt[c->mon->sellt]->arrange)
+		return LayerFloating;
+	return LayerTiled;
+}
+
 void
 clientmessage(XEvent *e)
 {
@@ -852,25 +1315,25 @@ clientmessage(XEvent *e)
 	if (showsystray && cme->window == systray->win && cme->message_type == netatom[NetSystemTrayOP]) {
 		/* add systray icons */
 		if (cme->data.l[1] == SYSTEM_TRAY_REQUEST_DOCK) {
-			if (!(c = (Client *)calloc(1, sizeof(Client))))
-				die("fatal: could not malloc() %u bytes\n", sizeof(Client));
+			c = newclient();
 			if (!(c->win = cme->data.l[2])) {
-				free(c);
+				freeclient(c);
 				return;
 			}
 			c->mon = selmon;
 			c->next = systray->icons;
 			systray->icons = c;
+			winset(c->win, WinIcon, c);
 			if (!XGetWindowAttributes(dpy, c->win, &wa)) {
 				/* use sane defaults */
 				wa.width = bh;
 				wa.height = bh;
 				wa.border_width = 0;
 			}
-			c->x = c->oldx = c->y = c->oldy = 0;
-			c->w = c->oldw = wa.width;
-			c->h = c->oldh = wa.height;
-			c->oldbw = wa.border_width;
+			c->x = c->ci->oldx = c->y = c->ci->oldy = 0;
+			c->w = c->ci->oldw = wa.width;
+			c->h = c->ci->oldh = wa.height;
+			c->ci->oldbw = wa.border_width;
 			c->bw = 0;
 			c->isfloating = True;
 			/* reuse tags field as mapped status */
@@ -888,9 +1351,7 @@ clientmessage(XEvent *e)
 			sendevent(c->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_FOCUS_IN, 0 , systray->win, XEMBED_EMBEDDED_VERSION);
 			sendevent(c->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_WINDOW_ACTIVATE, 0 , systray->win, XEMBED_EMBEDDED_VERSION);
 			sendevent(c->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_MODALITY_ON, 0 , systray->win, XEMBED_EMBEDDED_VERSION);
-			XSync(dpy, False);
-			resizebarwin(selmon);
-			updatesystray();
+			setdirty(selmon, DirtySystray);
 			setclientstate(c, NormalState);
 		}
 		return;
@@ -899,7 +1360,7 @@ clientmessage(XEvent *e)
 	if (cme->message_type == netatom[NetCurrentDesktop]) {
 		int tag = (cme->data.l[0] == (unsigned long)-1) ? TAGMASK : cme->data.l[0];
 //		fprintf(stderr, "NET_CURRENT_DESKTOP client %s: %lu = tag %d\n",
-//			c->name, cme->data.l[0], tag);
+//			c->ci->name, cme->data.l[0], tag);
 		Arg a = { .ui = 1 << tag  };
 		view(&a);
 	}
@@ -913,15 +1374,14 @@ clientmessage(XEvent *e)
 				|| (cme->data.l[0] == 2 /* _NET_WM_STATE_TOGGLE */ && !c->isfullscreen)));
 		else if (cme->data.l[1] == netatom[NetWMSkipTaskbar]
 			 || cme->data.l[2] == netatom[NetWMSkipTaskbar]) {
-			Window w = cme->window;
 			switch(cme->data.l[0]) {
 			case 0: //_NET_WM_STATE_REMOVE
-				atompropop(w, netatom[NetWMState], netatom[NetWMSkipTaskbar], 2); break;
+				netstateop(c, netatom[NetWMSkipTaskbar], 2); break;
 			case 1: //_NET_WM_STATE_ADD
-				atompropop(w, netatom[NetWMState], netatom[NetWMSkipTaskbar], 1); break;
+				netstateop(c, netatom[NetWMSkipTaskbar], 1); break;
 			case 2: //NET_WM_STATE_TOGGLE
-
-				atompropop(w, netatom[NetWMState], netatom[NetWMSkipTaskbar], atompropop(w, netatom[NetWMState], netatom[NetWMSkipTaskbar], 0) ? 2 : 1);
+				netstateop(c, netatom[NetWMSkipTaskbar],
+					   netstateop(c, netatom[NetWMSkipTaskbar], 0) ? 2 : 1);
 			}
 		}
 	} else if (cme->message_type == netatom[NetActiveWindow]) {
@@ -936,7 +1396,7 @@ clientmessage(XEvent *e)
 				view(&a);
 				focus(c);
 				c->raiseme = 1;
-				restack(selmon);
+				setdirty(selmon, DirtyStack);
 				//WARP(c);
 			}
 		}
@@ -948,7 +1408,7 @@ clientmessage(XEvent *e)
 		int tagno = (cme->data.l[0] == (unsigned long)-1)
 			? TAGMASK : cme->data.l[0];
 //		fprintf(stderr, "NET WM DESKTOP client %s: %lu = tag %d\n",
-//			c->name, cme->data.l[0], tagno) ;
+//			c->ci->name, cme->data.l[0], tagno) ;
 		if (selmon->sel == c) {
 				Arg a = { .ui = 1<< tagno };
 				tag(&a);
@@ -958,6 +1418,109 @@ clientmessage(XEvent *e)
 	}
 }
 
+int
+cmpint(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+int
+cmpkeysym(const void *a, const void *b)
+{
+	KeySym x = keys[*(const int *)a].keysym, y = keys[*(const int *)b].keysym;
+
+	return x < y ? -1 : x > y ? 1 : *(const int *)a - *(const int *)b;
+}
+
+/* drop events made redundant by a later event of the same batch */
+void
+coalesce(XEvent *ev, int n)
+{
+	int i, j, k;
+	XConfigureRequestEvent *a, *b;
+
+	for (k = n - 1; k >= 0; k--)
+		if (ev[k].type == EnterNotify
+		&& ((ev[k].xcrossing.mode == NotifyNormal && ev[k].xcrossing.detail != NotifyInferior)
+		|| ev[k].xcrossing.window == root))
+			break;
+	for (i = 0; i < n; i++) {
+		if (ev[i].type == EnterNotify && i < k) {
+			ev[i].type = 0; /* focus follows the last crossing */
+			continue;
+		}
+		if (ev[i].type != Expose && ev[i].type != PropertyNotify
+		&& ev[i].type != ConfigureRequest && ev[i].type != MotionNotify)
+			continue;
+		for (j = i + 1; j < n; j++) {
+			if (ev[j].type != ev[i].type)
+				continue;
+			if (ev[i].type == ConfigureRequest
+			? ev[j].xconfigurerequest.window != ev[i].xconfigurerequest.window
+			: ev[j].xany.window != ev[i].xany.window)
+				continue;
+			if (ev[i].type == PropertyNotify
+			&& (ev[j].xproperty.atom != ev[i].xproperty.atom
+			|| ev[j].xproperty.state != ev[i].xproperty.state))
+				continue;
+			if (ev[i].type == ConfigureRequest) {
+				a = &ev[i].xconfigurerequest;
+				b = &ev[j].xconfigurerequest;
+				/* border width changes are handled exclusively */
+				if ((a->value_mask | b->value_mask) & CWBorderWidth)
+					break;
+				if ((a->value_mask & CWX) && !(b->value_mask & CWX))
+					b->x = a->x;
+				if ((a->value_mask & CWY) && !(b->value_mask & CWY))
+					b->y = a->y;
+				if ((a->value_mask & CWWidth) && !(b->value_mask & CWWidth))
+					b->width = a->width;
+				if ((a->value_mask & CWHeight) && !(b->value_mask & CWHeight))
+					b->height = a->height;
+				if ((a->value_mask & CWSibling) && !(b->value_mask & CWSibling))
+					b->above = a->above;
+				if ((a->value_mask & CWStackMode) && !(b->value_mask & CWStackMode))
+					b->detail = a->detail;
+				b->value_mask |= a->value_mask;
+			}
+			ev[i].type = 0;
+			break;
+		}
+	}
+}
+
+/* index rules[] once: an automaton per field finds every rule whose
+ * pattern occurs in a string in one pass, see rulememo() */
+void
+compilerules(void)
+{
+	const char *field;
+	int i, f, p;
+
+	rulekeys = ecalloc(LENGTH(rules), sizeof(RuleKey));
+	rulehits = ecalloc(LENGTH(rules), sizeof(int));
+	rulecand = ecalloc(LENGTH(rules), sizeof(int));
+	openrules = ecalloc(LENGTH(rules), sizeof(int));
+	for (i = 0; i < LENGTH(rules); i++)
+		for (f = 0; f < RuleLast; f++) {
+			field = f == RuleClass ? rules[i].class
+			      : f == RuleInstance ? rules[i].instance : rules[i].title;
+			rulekeys[i].pat[f] = field ? acadd(&matcher[f], field) : -1;
+		}
+	for (f = 0; f < RuleLast; f++)
+		acbuild(&matcher[f]);
+	/* chain each pattern's rules back to front so the chains run in order */
+	for (i = LENGTH(rules); i-- > 0; )
+		for (f = 0; f < RuleLast; f++)
+			if ((p = rulekeys[i].pat[f]) >= 0) {
+				rulekeys[i].next[f] = matcher[f].first[p];
+				matcher[f].first[p] = i;
+			}
+	for (i = 0; i < LENGTH(rules); i++)
+		if (rulekeys[i].pat[RuleClass] < 0 && rulekeys[i].pat[RuleInstance] < 0)
+			openrules[nopenrules++] = i;
+}
+
 void
 configure(Client *c)
 {
@@ -1001,7 +1564,7 @@ configurenotify(XEvent *e)
 				resizebarwin(m);
 			}
 			focus(NULL);
-			arrange(NULL);
+			setdirty(NULL, DirtyArrange);
 		}
 	}
 }
@@ -1016,23 +1579,23 @@ configurerequest(XEvent *e)
 
 	if ((c = wintoclient(ev->window))) {
 		if (ev->value_mask & CWBorderWidth)
-			c->oldbw = c->bw = ev->border_width;
+			c->ci->oldbw = c->bw = ev->border_width;
 		else if (c->isfloating || !selmon->lt[selmon->sellt]->arrange) {
 			m = c->mon;
 			if (ev->value_mask & CWX) {
-				c->oldx = //c->x;
+				c->ci->oldx = //c->x;
 				c->x = m->mx + ev->x;
 			}
 			if (ev->value_mask & CWY) {
-				c->oldy = //c->y;
+				c->ci->oldy = //c->y;
 				c->y = m->my + ev->y;
 			}
 			if (ev->value_mask & CWWidth) {
-				c->oldw = //c->w;
+				c->ci->oldw = //c->w;
 				c->w = ev->width;
 			}
 			if (ev->value_mask & CWHeight) {
-				c->oldh = //c->h;
+				c->ci->oldh = //c->h;
 				c->h = ev->height;
 			}
 			if ((c->x + c->w) > m->mx + m->mw && c->isfloating)
@@ -1045,11 +1608,14 @@ configurerequest(XEvent *e)
 				changes.stack_mode = ev->detail;
 				XConfigureWindow(dpy,c->win,CWStackMode,
 						 &changes);
+				m->nstacking = -1; /* restack() must push again */
 			}
 			if ((ev->value_mask & (CWX|CWY)) && !(ev->value_mask & (CWWidth|CWHeight)))
 				configure(c);
-			if (ISVISIBLE(c))
+			if (ISVISIBLE(c)) {
 				XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
+				c->hidden = 0;
+			}
 		} else
 			configure(c);
 	} else {
@@ -1062,7 +1628,6 @@ configurerequest(XEvent *e)
 		wc.stack_mode = ev->detail;
 		XConfigureWindow(dpy, ev->window, ev->value_mask, &wc);
 	}
-	XSync(dpy, False);
 }
 
 Monitor *
@@ -1108,6 +1673,31 @@ createmon(void)
 	return m;
 }
 
+/* queue low-priority work for idle(); repeats collapse into one */
+void
+defer(unsigned int work)
+{
+	if (!idlework)
+		settimer(idletimer, IDLEDEADLINE, 0);
+	idlework |= work;
+}
+
+void
+defertags(Client *c)
+{
+	c->tagspending = 1;
+	defer(IdleTags);
+}
+
+void
+delwatch(Watch *w)
+{
+	epoll_ctl(epfd, EPOLL_CTL_DEL, w->fd, NULL);
+	if (w->istimer)
+		close(w->fd);
+	free(w);
+}
+
 void
 destroynotify(XEvent *e)
 {
@@ -1118,39 +1708,51 @@ destroynotify(XEvent *e)
 		unmanage(c, 1);
 	else if ((c = wintosystrayicon(ev->window))) {
 		removesystrayicon(c);
-		resizebarwin(selmon);
-		updatesystray();
+		setdirty(selmon, DirtySystray);
 	}
 	else if ((c = swallowingclient(ev->window)))
-		unmanage(c->swallowing, 1);
+		unmanage(c->ci->swallowing, 1);
 }
 
 void
 detach(Client *c)
 {
-	Client **tc;
-
-	for (tc = &c->mon->clients; *tc && *tc != c; tc = &(*tc)->next);
-	*tc = c->next;
+	if (!c->inclients)
+		return;
+	tagcount(c, -1);
+	c->inclients = 0;
+	if (c->prev)
+		c->prev->next = c->next;
+	else
+		c->mon->clients = c->next;
+	if (c->next)
+		c->next->prev = c->prev;
+	else
+		c->mon->clientstail = c->prev;
+	c->next = c->prev = NULL;
+	c->mon->visvalid = 0;
 }
 
 void
 detachstack(Client *c)
 {
-	Client **tc, *t;
-
-	for (tc = &c->mon->stack; *tc && *tc != c; tc = &(*tc)->snext);
-	*tc = c->snext;
+	if (!c->instack)
+		return;
+	mruunlink(c);
+	c->instack = 0;
+	if (c->sprev)
+		c->sprev->snext = c->snext;
+	else
+		c->mon->stack = c->snext;
+	if (c->snext)
+		c->snext->sprev = c->sprev;
+	else
+		c->mon->stacktail = c->sprev;
+	c->snext = c->sprev = NULL;
+	defer(IdleStacking);
 
-	if (c == c->mon->sel) {
-		for (t = c->mon->stack; t && !ISVISIBLE(t); t = t->snext);
-		c->mon->sel = (t == c) ? NULL : t;
-		{ //madhu 131023 - TODO FIGURE OUT HOW TO PRINT A STACKBACKTRACE HERE
-			if (t == c)
-				fprintf(stderr,"FIXME: cornercase: detachstack(%p)=%lu %s fails\n",
-					(void *)c, c->win,c->name);
-		}
-	}
+	if (c == c->mon->sel)
+		c->mon->sel = mrutop(c->mon, 0);
 }
 
 Monitor *
@@ -1168,13 +1770,33 @@ dirtomon(int dir)
 	return m;
 }
 
+/* run the handlers for a batch in order; once the batch shows a backlog,
+ * hold the cosmetic ones back until everything else has run */
+void
+dispatch(XEvent *ev, int n)
+{
+	static const int pass[] = { PrioStructure, PrioCosmetic };
+	int i, p;
+
+	if (n < BACKLOG) {
+		for (i = 0; i < n && running; i++)
+			if (handler[ev[i].type])
+				handler[ev[i].type](&ev[i]); /* call handler */
+		return;
+	}
+	for (p = 0; p < LENGTH(pass); p++)
+		for (i = 0; i < n && running; i++)
+			if (handler[ev[i].type] && prio[ev[i].type] == pass[p])
+				handler[ev[i].type](&ev[i]);
+}
+
 void
 drawbar(Monitor *m)
 {
 	int x, w, tw = 0, stx = 0, stw = 0;
 	int boxs = drw->fonts->h / 9;
 	int boxw = drw->fonts->h / 6 + 2;
-	unsigned int i, occ = 0, urg = 0, n = 0;
+	unsigned int i, occ = m->occ, urg = m->urg, n = 0;
 	Client *c;
 
 	if (!m->showbar)
@@ -1190,15 +1812,8 @@ drawbar(Monitor *m)
 		drw_text(drw, m->ww - tw - stx -stw, 0, tw, bh, lrpad / 2 - 2, stext, 0);
 	}
 
-	resizebarwin(m);
-	for (c = m->clients; c; c = c->next) {
-		if (ISVISIBLE(c))
-			n++;
-		if (c->tags != TAGMASK)
-			occ |= c->tags;
-		if (c->isurgent)
-			urg |= c->tags;
-	}
+	updatevis(m);
+	n = m->nvis;
 	x = 0;
 	for (i = 0; i < LENGTH(tags); i++) {
 		w = TEXTW(tags[i]);
@@ -1217,15 +1832,14 @@ drawbar(Monitor *m)
 	if ((w = (n > 0) ? (m->ww - tw -stw - x)/n : (m->ww - tw - stw - x)) > bh) {
 		stx = m->ww - tw;
 		if (m->sel  || (lose_focus && n != 0)) {
-			for (c = m->clients, i = 1; c; c = c->next) {
-				if (ISVISIBLE(c)) {
-					drw_setscheme(drw, scheme[c == selmon->sel ? SchemeSel : SchemeNorm]);
-					drw_text(drw, x, 0, w, bh, lrpad / 2, c->name, 0);
-					if (c->isfloating)
-						drw_rect(drw, x + boxs, boxs, boxw, boxw, c->isfixed, 0);
-					x += w;
-					w = ++i < n ? w : stx - x;
-				}
+			for (i = 0; i < n; i++) {
+				c = m->vis[i];
+				drw_setscheme(drw, scheme[c == selmon->sel ? SchemeSel : SchemeNorm]);
+				drw_text(drw, x, 0, w, bh, lrpad / 2, c->ci->name, 0);
+				if (c->isfloating)
+					drw_rect(drw, x + boxs, boxs, boxw, boxw, c->isfixed, 0);
+				x += w;
+				w = i + 2 < n ? w : stx - x;
 			}
 		} else {
 			drw_setscheme(drw, scheme[SchemeNorm]);
@@ -1235,18 +1849,121 @@ drawbar(Monitor *m)
 	drw_map(drw, m->barwin, 0, 0, m->ww - stw, bh);
 }
 
+/* Mutating functions only mark monitors dirty through setdirty(); the
+ * X work happens here, once per batch and only for monitors that changed. */
 void
-drawbars(void)
+commit(void)
 {
+	static Monitor *lastsel = NULL;
+	char ltsymbol[sizeof selmon->ltsymbol];
 	Monitor *m;
-
+	Client *c;
+	XEvent ev;
+	XWindowChanges wc;
+	unsigned int all = 0, mask;
+
+	if (selmon != lastsel) {
+		/* status, selection and a sloppy systray follow selmon */
+		for (m = mons; m && m != lastsel; m = m->next);
+		if (m)
+			m->dirty |= DirtyBar;
+		selmon->dirty |= DirtyBar|DirtySystray;
+		lastsel = selmon;
+	}
 	for (m = mons; m; m = m->next)
-		drawbar(m);
-	updatesystray();
+		all |= m->dirty;
+	if (!all)
+		return;
+	if (all & DirtySystray) {
+		for (m = mons; m; m = m->next)
+			resizebarwin(m);
+		updatesystray();
+	}
+	for (m = mons; m; m = m->next)
+		if (m->dirty & DirtyLayout)
+			showhide(m->stack);
+	for (m = mons; m; m = m->next) {
+		if (m->dirty & DirtyLayout) {
+			memcpy(ltsymbol, m->ltsymbol, sizeof ltsymbol);
+			arrangemon(m);
+			if (memcmp(ltsymbol, m->ltsymbol, sizeof ltsymbol))
+				m->dirty |= DirtyTags;
+		}
+		if (m->dirty & DirtyStack)
+			restack(m);
+		if (m->dirty & DirtyBar)
+			drawbar(m);
+		all |= m->dirty;
+		m->dirty = 0;
+	}
+	if (all & DirtyNetState)
+		for (m = mons; m; m = m->next)
+			for (c = m->clients; c; c = c->next)
+				if (c->ci->sh.netstatedirty)
+					flushnetstate(c);
+	if (all & DirtyGeom)
+		for (m = mons; m; m = m->next)
+			for (c = m->clients; c; c = c->next) {
+				if (!c->geomdirty)
+					continue;
+				wc.x = c->hidden == 1 ? c->x + 2 * sw : c->x;
+				wc.y = c->y;
+				wc.width = c->w;
+				wc.height = c->h;
+				wc.border_width = c->bw;
+				mask = CWX|CWY|CWWidth|CWHeight;
+				if (!SHADOWED(&c->ci->sh, ShBorderWidth, bw, c->bw))
+					mask |= CWBorderWidth;
+				XConfigureWindow(dpy, c->win, mask, &wc);
+				configure(c);
+				c->geomdirty = 0;
+			}
+	if (all & (DirtyLayout|DirtyStack|DirtyGeom)) {
+		/* swallow the crossings caused by moving windows around */
+		XSync(dpy, False);
+		while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
+	}
 }
 
 Time	Last_Event_Time = CurrentTime;
 
+void
+dropprefetch(Prefetch *pf)
+{
+	unsigned int i;
+
+	for (i = 0; i < PfLast; i++)
+		if (pf->have & 1 << i)
+			free(pf->reply[i]);
+		else
+			xcb_discard_reply(xc, pf->prop[i].sequence);
+}
+
+void
+droprulememos(void)
+{
+	RuleMemo *rm;
+	int i;
+
+	for (i = 0; i < LENGTH(rulememos); i++)
+		while ((rm = rulememos[i])) {
+			rulememos[i] = rm->next;
+			free(rm);
+		}
+	nrulememos = 0;
+}
+
+/* a window was raised behind restack()'s back: forget what it pushed */
+void
+dropstacking(void)
+{
+	Monitor *m;
+
+	for (m = mons; m; m = m->next)
+		m->nstacking = -1;
+	setdirty(NULL, DirtyStack);
+}
+
 void
 enternotify(XEvent *e)
 {
@@ -1274,17 +1991,18 @@ expose(XEvent *e)
 	Monitor *m;
 	XExposeEvent *ev = &e->xexpose;
 
-	if (ev->count == 0 && (m = wintomon(ev->window))) {
-		drawbar(m);
-		if (m == selmon)
-			updatesystray();
-	}
+	if (ev->count == 0 && (m = wintomon(ev->window)))
+		setdirty(m, DirtyBar | (m == selmon ? DirtySystray : 0));
 }
 
 void
 window_opacity_set(Client *c, double opacity)
 {
-	if (opacity >= 0 && opacity <= 1) {
+	if (!(opacity >= 0 && opacity <= 1))
+		opacity = -1;
+	if (SHADOWED(&c->ci->sh, ShOpacity, opacity, opacity))
+		return;
+	if (opacity >= 0) {
 		unsigned long real_opacity[] = { opacity * 0xffffffff };
 		XChangeProperty(dpy, c->win, netatom[NetWMWindowOpacity], XA_CARDINAL, 32, PropModeReplace, (unsigned char *)real_opacity, 1);
 	}
@@ -1292,14 +2010,47 @@ window_opacity_set(Client *c, double opacity)
 		XDeleteProperty(dpy, c->win, netatom[NetWMWindowOpacity]);
 }
 
+/* collect the attributes prefetch() asked for; False if the window is gone */
+Bool
+fetchattrs(Prefetch *pf, XWindowAttributes *wa)
+{
+	xcb_get_window_attributes_reply_t *a;
+	xcb_get_geometry_reply_t *g;
+	Bool ok;
+
+	a = xcb_get_window_attributes_reply(xc, pf->attrs, NULL);
+	g = xcb_get_geometry_reply(xc, pf->geom, NULL);
+	if ((ok = a && g)) {
+		memset(wa, 0, sizeof(*wa));
+		wa->x = g->x;
+		wa->y = g->y;
+		wa->width = g->width;
+		wa->height = g->height;
+		wa->border_width = g->border_width;
+		wa->depth = g->depth;
+		wa->root = g->root;
+		wa->class = a->_class;
+		wa->map_state = a->map_state;
+		wa->override_redirect = a->override_redirect;
+	}
+	free(a);
+	free(g);
+	return ok;
+}
+
 Client *
 findbefore(Client *c)
 {
-	Client *tmp;
-	if (c == selmon->clients)
-		return NULL;
-	for (tmp = selmon->clients; tmp && tmp->next != c; tmp = tmp->next);
-	return tmp;
+	return c && c->mon == selmon ? c->prev : NULL;
+}
+
+void
+flushnetstate(Client *c)
+{
+	XChangeProperty(dpy, c->win, netatom[NetWMState], XA_ATOM, 32,
+		PropModeReplace, (unsigned char *)c->ci->sh.netstate,
+		c->ci->sh.nnetstate);
+	c->ci->sh.netstatedirty = 0;
 }
 
 void
@@ -1310,20 +2061,17 @@ focus(Client *c)
 	if (!c || !ISVISIBLE(c))
 		// first restrict search to clients which were not
 		// visible in the previous view.
-		for (c = selmon->stack; c &&
-			     ((c->tags & c->mon->tagset[1 - c->mon->seltags])
-			      ||  !ISVISIBLE(c));
-		     c = c->snext);
+		c = mrutop(selmon, selmon->tagset[1 - selmon->seltags]);
 
 	if (!c || !ISVISIBLE(c))
 		// search failed. broaden search to all clients in the
 		// current view
-		for (c = selmon->stack; c && !ISVISIBLE(c); c = c->snext);
+		c = mrutop(selmon, 0);
 
 skip_choose:
 	if (selmon->sel && selmon->sel != c) {
 		unfocus(selmon->sel, 0);
-		float o = selmon->sel->opacity;
+		float o = selmon->sel->ci->opacity;
 		if ((o <= 0.0) || (o > 1.0) || (o != 1.0) /*&& (o >= shade)*/)
 			window_opacity_set(selmon->sel, shade);
 	}
@@ -1332,32 +2080,34 @@ skip_choose:
 			selmon = c->mon;
 		if (c->isurgent)
 			seturgent(c, 0);
-		detachstack(c);
-		attachstack(c);
+		if (c != c->mon->stack) {
+			detachstack(c);
+			attachstack(c);
+		}
 		grabbuttons(c, 1);
-		XSetWindowBorder(dpy, c->win, scheme[SchemeSel][ColBorder].pixel);
+		setborder(c, scheme[SchemeSel][ColBorder].pixel);
 		setfocus(c);
 	} else {
 		XSetInputFocus(dpy, root, RevertToPointerRoot, CurrentTime);
-		XDeleteProperty(dpy, root, netatom[NetActiveWindow]);
+		setactivewindow(None);
 	}
 	selmon->sel = c;
-	drawbars();
-	if(c) window_opacity_set(c, c->opacity);
+	setdirty(selmon, DirtyTags|DirtyTitle);
+	if(c) window_opacity_set(c, c->ci->opacity);
 }
 
 void
 focusclienttaskbar(const Arg *arg)
 {
-    Client *c;
+	Client *c;
 
-    for (c = selmon->clients; c; c = c->next)
-		if (ISVISIBLE(c) && --ncc < 0) {
-		focus(c);
-		c->raiseme = 1;
-		restack(selmon);
-			break;
-		}
+	updatevis(selmon);
+	if (ncc < 0 || ncc >= selmon->nvis)
+		return;
+	c = selmon->vis[ncc];
+	focus(c);
+	c->raiseme = 1;
+	setdirty(selmon, DirtyStack);
 }
 
 /* there are some broken focus acquiring clients needing extra handling */
@@ -1387,18 +2137,24 @@ focusmon(const Arg *arg)
 void
 focusstack(const Arg *arg)
 {
-	int i = stackpos(arg, ISINC(arg->i));
-	Client *c, *p;
+	int i = stackpos(arg, ISINC(arg->i)), n;
+	Client **v;
 
 	if (i < 0)
 		return;
-#define Y_ISVISIBLE(C) ((ISINC(arg->i) ? X_ISVISIBLE(C) : ISVISIBLE(C)))
+	v = ISINC(arg->i) ? selmon->xvis : selmon->vis;
+	n = ISINC(arg->i) ? selmon->nxvis : selmon->nvis;
+	focus(n ? v[MIN(i, n - 1)] : NULL);
+	setdirty(selmon, DirtyStack);
+}
 
-	for (p = NULL, c = selmon->clients; c && (i || !Y_ISVISIBLE(c));
-	    i -= Y_ISVISIBLE(c) ? 1 : 0, p = c, c = c->next);
-	focus(c ? c : p);
-	restack(selmon);
-#undef Y_ISVISIBLE
+void
+freeclient(Client *c)
+{
+	if (!c)
+		return;
+	pfree(&infopool, c->ci);
+	pfree(&clientpool, c);
 }
 
 Atom
@@ -1478,94 +2234,170 @@ getrootptr(int *x, int *y)
 	return XQueryPointer(dpy, root, &dummy, &dummy, x, y, &di, &di, &dui);
 }
 
-long
-getstate(Window w)
+int
+gettextprop(Window w, Atom atom, char *text, unsigned int size)
 {
-	int format;
-	long result = -1;
-	unsigned char *p = NULL;
-	unsigned long n, extra;
-	Atom real;
+	XTextProperty name;
+	int ret;
 
-	if (XGetWindowProperty(dpy, w, wmatom[WMState], 0L, 2L, False, wmatom[WMState],
-		&real, &format, &n, &extra, &p) != Success)
-		return -1;
-	if (n != 0 && format == 32)
-		result = *(long *)p;
-	XFree(p);
-	return result;
+	if (!text || size == 0)
+		return 0;
+	text[0] = '\0';
+	if (!XGetTextProperty(dpy, w, &name, atom))
+		return 0;
+	ret = textpropcpy(&name, text, size);
+	XFree(name.value);
+	return ret;
 }
 
+/* name's value need not be NUL-terminated when it comes from XCB */
 int
-gettextprop(Window w, Atom atom, char *text, unsigned int size)
+textpropcpy(XTextProperty *name, char *text, unsigned int size)
 {
 	char **list = NULL;
 	int n;
-	XTextProperty name;
 
-	if (!text || size == 0)
-		return 0;
-	text[0] = '\0';
-	if (!XGetTextProperty(dpy, w, &name, atom) || !name.nitems)
+	if (!name->nitems)
 		return 0;
-	if (name.encoding == XA_STRING) {
-		strncpy(text, (char *)name.value, size - 1);
-	} else if (XmbTextPropertyToTextList(dpy, &name, &list, &n) >= Success && n > 0 && *list) {
+	if (name->encoding == XA_STRING) {
+		n = MIN(name->nitems, size - 1);
+		strncpy(text, (char *)name->value, n);
+		text[n] = '\0';
+	} else if (XmbTextPropertyToTextList(dpy, name, &list, &n) >= Success && n > 0 && *list) {
 		strncpy(text, *list, size - 1);
 		XFreeStringList(list);
 	}
 	text[size - 1] = '\0';
-	XFree(name.value);
 	return 1;
 }
 
 void
 grabbuttons(Client *c, int focused)
 {
-	updatenumlockmask();
-	{
-		unsigned int i, j;
-		unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
-		XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
-		if (focused) {
-			for (i = 0; i < LENGTH(buttons); i++)
-				if (buttons[i].click == ClkClientWin)
-					for (j = 0; j < LENGTH(modifiers); j++)
-						XGrabButton(dpy, buttons[i].button,
-							    buttons[i].mask | modifiers[j],
-							    c->win, False, BUTTONMASK,
-							    GrabModeSync, GrabModeAsync, None, None);
-		} else
- 			XGrabButton(dpy, AnyButton, AnyModifier, c->win, False,
-				    BUTTONMASK, GrabModeSync, GrabModeAsync, None, None);
- 	}
+	unsigned int i, j;
+	unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
+
+	if (SHADOWED(&c->ci->sh, ShButtons, buttons, focused))
+		return;
+	XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
+	if (focused) {
+		for (i = 0; i < LENGTH(buttons); i++)
+			if (buttons[i].click == ClkClientWin)
+				for (j = 0; j < LENGTH(modifiers); j++)
+					XGrabButton(dpy, buttons[i].button,
+						    buttons[i].mask | modifiers[j],
+						    c->win, False, BUTTONMASK,
+						    GrabModeSync, GrabModeAsync, None, None);
+	} else
+		XGrabButton(dpy, AnyButton, AnyModifier, c->win, False,
+			    BUTTONMASK, GrabModeSync, GrabModeAsync, None, None);
 }
 
+/* rebuild the keycode table keypress() dispatches through and regrab,
+ * but only when the keyboard mapping or numlockmask changed the result */
 void
 grabkeys(void)
 {
+	unsigned int j, oldnumlock = numlockmask, modifiers[4];
+	int i, k, lo, hi, mid, start, end, skip, n = 0, cap = LENGTH(keys);
+	int first[LENGTH(keyfirst)] = { 0 }, count[LENGTH(keycount)] = { 0 };
+	KeySym *syms, sym;
+	KeyBind *kb;
+
+	if (!keyorder) {
+		keyorder = ecalloc(LENGTH(keys), sizeof(int));
+		for (i = 0; i < LENGTH(keys); i++)
+			keyorder[i] = i;
+		qsort(keyorder, LENGTH(keys), sizeof(int), cmpkeysym);
+	}
 	updatenumlockmask();
-	{
-		unsigned int i, j, k;
-		unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
-		int start, end, skip;
-		KeySym *syms;
-
-		XUngrabKey(dpy, AnyKey, AnyModifier, root);
-		XDisplayKeycodes(dpy, &start, &end);
-		syms = XGetKeyboardMapping(dpy, start, end - start + 1, &skip);
-		if (!syms)
-			return;
-		for (k = start; k <= end; k++)
-			for (i = 0; i < LENGTH(keys); i++)
-				/* skip modifier codes, we do that ourselves */
-				if (keys[i].keysym == syms[(k - start) * skip])
-					for (j = 0; j < LENGTH(modifiers); j++)
-						XGrabKey(dpy, k,
-							 keys[i].mod | modifiers[j],
-							 root, True,
-							 GrabModeAsync, GrabModeAsync);
-		XFree(syms);
+	XDisplayKeycodes(dpy, &start, &end);
+	end = MIN(end, (int)LENGTH(keyfirst) - 1);
+	if (!(syms = XGetKeyboardMapping(dpy, start, end - start + 1, &skip)))
+		return;
+	kb = ecalloc(cap, sizeof(KeyBind));
+	for (k = start; k <= end; k++) {
+		first[k] = n;
+		/* skip modifier codes, we do that ourselves */
+		sym = syms[(k - start) * skip];
+		for (lo = 0, hi = LENGTH(keys); lo < hi; )
+			if (keys[keyorder[mid = (lo + hi) / 2]].keysym < sym)
+				lo = mid + 1;
+			else
+				hi = mid;
+		for (; lo < LENGTH(keys) && keys[keyorder[lo]].keysym == sym; lo++) {
+			if (n == cap && !(kb = realloc(kb, (cap *= 2) * sizeof(KeyBind))))
+				die("fatal: could not malloc() %zu bytes\n", cap * sizeof(KeyBind));
+			kb[n].mod = CLEANMASK(keys[keyorder[lo]].mod);
+			kb[n++].key = keyorder[lo];
+		}
+		count[k] = n - first[k];
+	}
+	XFree(syms);
+	if (numlockmask == oldnumlock && keybinds && n == nkeybinds
+	&& !memcmp(kb, keybinds, n * sizeof(KeyBind))
+	&& !memcmp(first, keyfirst, sizeof first)
+	&& !memcmp(count, keycount, sizeof count)) {
+		free(kb);
+		return;
+	}
+	free(keybinds);
+	keybinds = kb;
+	nkeybinds = n;
+	memcpy(keyfirst, first, sizeof first);
+	memcpy(keycount, count, sizeof count);
+
+	modifiers[0] = 0;
+	modifiers[1] = LockMask;
+	modifiers[2] = numlockmask;
+	modifiers[3] = numlockmask|LockMask;
+	XUngrabKey(dpy, AnyKey, AnyModifier, root);
+	for (k = start; k <= end; k++)
+		for (i = keyfirst[k]; i < keyfirst[k] + keycount[k]; i++) {
+			/* one grab per keycode and modifier combination */
+			for (n = keyfirst[k]; n < i && keybinds[n].mod != keybinds[i].mod; n++);
+			if (n < i)
+				continue;
+			for (j = 0; j < LENGTH(modifiers); j++)
+				XGrabKey(dpy, k, keybinds[i].mod | modifiers[j],
+					 root, True, GrabModeAsync, GrabModeAsync);
+		}
+}
+
+/* run deferred work; called when the event queue is empty, or by
+ * idletimer when a flood of events keeps it from ever being empty */
+void
+idle(Watch *w)
+{
+	unsigned int work = idlework;
+	Monitor *m;
+	Client *c;
+	XSetWindowAttributes wa;
+
+	if (!work)
+		return;
+	idlework = 0;
+	settimer(idletimer, 0, 0);
+	if (work & IdleClientList)
+		updateclientlist();
+	if (work & IdleStacking)
+		updatestackinglist();
+	if (work & IdleCurrentDesktop)
+		set_net_current_desktop();
+	if (work & IdleDesktopNames)
+		updatedesktopnames();
+	if (work & IdleTags)
+		for (m = mons; m; m = m->next)
+			for (c = m->clients; c; c = c->next)
+				if (c->tagspending) {
+					settagsprop(c, c->tags);
+					c->tagspending = 0;
+				}
+	if (work & IdleSystray && showsystray && systray) {
+		/* make sure the background color stays the same */
+		wa.background_pixel = scheme[SchemeNorm][ColBg].pixel;
+		for (c = systray->icons; c; c = c->next)
+			XChangeWindowAttributes(dpy, c->win, CWBackPixel, &wa);
 	}
 }
 
@@ -1573,7 +2405,7 @@ void
 incnmaster(const Arg *arg)
 {
 	selmon->nmaster = selmon->pertag->nmasters[selmon->pertag->curtag] = MAX(selmon->nmaster + arg->i, 0);
-	arrange(selmon);
+	setdirty(selmon, DirtyLayout);
 }
 
 void
@@ -1581,7 +2413,7 @@ incnstackcols(const Arg *arg)
 {
 	int new = selmon->n_non_master_columns + arg->i;
 	selmon->n_non_master_columns = selmon->pertag->n_non_master_columns[selmon->pertag->curtag] = MAX(new, 1);
-	arrange(selmon);
+	setdirty(selmon, DirtyLayout);
 }
 
 #ifdef XINERAMA
@@ -1599,54 +2431,77 @@ isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
 void
 keypress(XEvent *e)
 {
-	unsigned int i;
-	KeySym keysym;
+	int i, n;
+	const Key *k;
 	XKeyEvent *ev;
 
 	ev = &e->xkey;
-	keysym = XKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0);
-	for (i = 0; i < LENGTH(keys); i++)
-		if (keysym == keys[i].keysym
-		&& CLEANMASK(keys[i].mod) == CLEANMASK(ev->state)
-		&& keys[i].func)
-			keys[i].func(&(keys[i].arg));
+	if (ev->keycode >= LENGTH(keyfirst))
+		return;
+	for (i = keyfirst[ev->keycode], n = i + keycount[ev->keycode]; i < n; i++) {
+		k = &keys[keybinds[i].key];
+		if (keybinds[i].mod == CLEANMASK(ev->state) && k->func)
+			k->func(&k->arg);
+	}
 }
 
 void
 killclient(const Arg *arg)
 {
+	unsigned long first;
+
 	if (!selmon->sel)
 		return;
 
-	if (!sendevent(selmon->sel->win, wmatom[WMDelete], NoEventMask, wmatom[WMDelete], CurrentTime, 0 , 0, 0)) {
+	if (!sendprotocol(selmon->sel, wmatom[WMDelete], CurrentTime)) {
+		first = NextRequest(dpy);
 		XGrabServer(dpy);
-		XSetErrorHandler(xerrordummy);
 		XSetCloseDownMode(dpy, DestroyAll);
 		XKillClient(dpy, selmon->sel->win);
-		XSync(dpy, False);
-		XSetErrorHandler(xerror);
 		XUngrabServer(dpy);
+		xignore(first);
 	}
 }
 
 void
-manage(Window w, XWindowAttributes *wa)
+manage(Window w, XWindowAttributes *wa, Prefetch *pf)
 {
 	Client *c, *t = NULL, *term = NULL;
 	Window trans = None;
 	XWindowChanges wc;
+	xcb_get_property_reply_t *r[PfLast];
+	XSizeHints size;
+	XWMHints wmh;
+	uint32_t *tp, *state, *wtype, *tags; /* XCB hands out 32-bit items */
+	unsigned int i;
+	int n, *pid;
+	char ch[64 * 4 + 1], *p;
+	const char *class = broken, *instance = broken;
+
+	/* everything below was requested by prefetch(); wait for it once */
+	for (i = 0; i < PfLast; i++)
+		r[i] = prefetched(pf, i);
+	if (!propsizehints(r[PfNormalHints], &size))
+		/* size is uninitialized, ensure that size.flags aren't used */
+		size.flags = PSize;
+	if ((tp = propvalue(r[PfTransient], XA_WINDOW, 32, 1)))
+		trans = *tp;
+	if ((p = propvalue(r[PfClass], XA_STRING, 8, 1))) {
+		/* WM_CLASS is "instance\0class\0" */
+		n = MIN(xcb_get_property_value_length(r[PfClass]), (int)sizeof ch - 1);
+		memcpy(ch, p, n);
+		ch[n] = '\0';
+		instance = ch;
+		class = ch + MIN((int)strlen(ch) + 1, n);
+	}
 
-	c = ecalloc(1, sizeof(Client));
+	c = newclient();
 	c->win = w;
 	/* geometry */
 	c->mon = selmon;	// XXX FIXME ;madhu 160725
 
 	// centered placement of new windows
 	if (wa->map_state != IsViewable) {
-		XSizeHints size;
-		long tmp;
-		if (!XGetWMNormalHints(dpy, w, &size, &tmp))
-			size.flags = 0;
 		if (!(size.flags & (USPosition | PPosition))) {
 			int px, py;
 			if ((placement_style == under_mouse) &&
@@ -1660,21 +2515,24 @@ manage(Window w, XWindowAttributes *wa)
 		}
 	}
 
-	c->x = c->oldx = (wa->x % sw) + c->mon->wx;
-	c->y = c->oldy = wa->y + ((c->mon->topbar == True && wa->y !=0 ) ? 0 : c->mon->wy);
-	c->w = c->oldw = wa->width;
-	c->h = c->oldh = wa->height;
-	c->oldbw = wa->border_width;
-
-	updatetitle(c);
-	c->opacity=-1;
-	c->pid = getcardprop(c, netatom[NetWMPid]);
-	if (XGetTransientForHint(dpy, w, &trans) && (t = wintoclient(trans))) {
+	c->x = c->ci->oldx = (wa->x % sw) + c->mon->wx;
+	c->y = c->ci->oldy = wa->y + ((c->mon->topbar == True && wa->y !=0 ) ? 0 : c->mon->wy);
+	c->w = c->ci->oldw = wa->width;
+	c->h = c->ci->oldh = wa->height;
+	c->ci->oldbw = wa->border_width;
+
+	if (!proptext(r[PfNetWMName], c->ci->name, sizeof c->ci->name))
+		proptext(r[PfWMName], c->ci->name, sizeof c->ci->name);
+	if (c->ci->name[0] == '\0') /* hack to mark broken clients */
+		strcpy(c->ci->name, broken);
+	c->ci->opacity=-1;
+	c->ci->pid = (pid = propvalue(r[PfPid], XA_CARDINAL, 32, 1)) ? *pid : -1;
+	if (tp && (t = wintoclient(trans))) {
 		c->mon = t->mon;
 		c->tags = t->tags;
 	} else {
 		c->mon = selmon;
-		applyrules(c);
+		applyrules(c, class, instance);
 		term = termforwin(c);
 	}
 
@@ -1687,66 +2545,87 @@ manage(Window w, XWindowAttributes *wa)
 	c->bw = borderpx;
 
 	wc.border_width = c->bw;
-	XConfigureWindow(dpy, w, CWBorderWidth, &wc);
-	XSetWindowBorder(dpy, w, scheme[SchemeNorm][ColBorder].pixel);
+	if (!SHADOWED(&c->ci->sh, ShBorderWidth, bw, c->bw))
+		XConfigureWindow(dpy, w, CWBorderWidth, &wc);
+	setborder(c, scheme[SchemeNorm][ColBorder].pixel);
 	configure(c); /* propagates border_width, if size doesn't change */
-	updatewindowtype(c);
-	updatesizehints(c);
-	updatewmhints(c);
-	c->oldx = c->x;
-	c->oldy = c->y;
-	c->oldw = c->w;
-	c->oldh = c->h;
-	c->oldbw = c->bw;
+	if ((state = propvalue(r[PfState], XA_ATOM, 32, 1)))
+		for (i = 0; i < r[PfState]->value_len && i < MAXNETSTATE; i++)
+			c->ci->sh.netstate[c->ci->sh.nnetstate++] = state[i];
+	wtype = propvalue(r[PfType], XA_ATOM, 32, 1);
+	setwindowtype(c, netstateop(c, netatom[NetWMFullscreen], 0)
+		      ? netatom[NetWMFullscreen] : None, wtype ? *wtype : None);
+	setsizehints(c, &size);
+	if (propwmhints(r[PfHints], &wmh))
+		setwmhints(c, &wmh);
+	if ((tp = propvalue(r[PfProtocols], XA_ATOM, 32, 1)))
+		for (i = 0; i < r[PfProtocols]->value_len; i++)
+			c->ci->protocols |= protobit(tp[i]);
+	c->ci->oldx = c->x;
+	c->ci->oldy = c->y;
+	c->ci->oldw = c->w;
+	c->ci->oldh = c->h;
+	c->ci->oldbw = c->bw;
 	XSelectInput(dpy, w, EnterWindowMask|FocusChangeMask|PropertyChangeMask|StructureNotifyMask);
 	grabbuttons(c, 0);
-	updatetitle(c);
-	XTextProperty prop;
-	applyrules(c);
-	if (XGetTextProperty(dpy, c->win, &prop, dwmatom[DWMTags])) {
-		c->tags = *(unsigned int *)prop.value;
-		XFree(prop.value);
+	applyrules(c, class, instance);
+	if ((tags = propvalue(r[PfTags], AnyPropertyType, 32, 1))) {
+		c->tags = *tags;
 	} else {
-		if (XGetTransientForHint(dpy, w, &trans))
+		if (tp)
 			t = wintoclient(trans);
 		if (t)
 			c->tags = t->tags;
 	}
+	for (i = 0; i < PfLast; i++)
+		free(r[i]);
 	if (!c->tags)
 		c->tags = selmon->tagset[selmon->seltags];
-	settagsprop(c->win, c->tags);
+	defertags(c);
 	if (!c->isfloating)
-		c->isfloating = c->oldstate = trans != None || c->isfixed;
+		c->isfloating = c->ci->oldstate = trans != None || c->isfixed;
 	if (c->isfloating)
-		if (!c->isdesktop) XRaiseWindow(dpy, c->win);
+		c->raised = ++raiseseq;
 	if (!attach_bottom_p)
 		attach(c);
 	else
 		attachbottom(c);
 	attachstack(c);
-	XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend,
-		(unsigned char *) &(c->win), 1);
+	winset(c->win, WinClient, c);
 	XMoveResizeWindow(dpy, c->win, c->x + 2 * sw, c->y, c->w, c->h); /* some windows require this */
+	c->hidden = 1;
 	setclientstate(c, NormalState);
 	if (c->mon == selmon)
 		unfocus(selmon->sel, 0);
 	c->mon->sel = c;
-	arrange(c->mon);
+	setdirty(c->mon, DirtyArrange);
 	XMapWindow(dpy, c->win);
 	if (term)
 		swallow(term, c);
+	defer(IdleClientList);
+	if (scanning) /* scan() focuses once for all windows */
+		return;
 	focus(NULL);
-	updateclientlist();
 }
 
 void
 mappingnotify(XEvent *e)
 {
 	XMappingEvent *ev = &e->xmapping;
+	unsigned int oldnumlock = numlockmask;
+	Monitor *m;
+	Client *c;
 
 	XRefreshKeyboardMapping(ev);
-	if (ev->request == MappingKeyboard)
-		grabkeys();
+	if (ev->request != MappingKeyboard && ev->request != MappingModifier)
+		return;
+	grabkeys();
+	if (numlockmask != oldnumlock)
+		for (m = mons; m; m = m->next)
+			for (c = m->clients; c; c = c->next) {
+				c->ci->sh.known &= ~ShButtons;
+				grabbuttons(c, c == selmon->sel);
+			}
 }
 
 void
@@ -1754,33 +2633,66 @@ maprequest(XEvent *e)
 {
 	static XWindowAttributes wa;
 	XMapRequestEvent *ev = &e->xmaprequest;
+	Prefetch pf;
 
 	Client *i;
 	if ((i = wintosystrayicon(ev->window))) {
 		sendevent(i->win, netatom[Xembed], StructureNotifyMask, CurrentTime, XEMBED_WINDOW_ACTIVATE, 0, systray->win, XEMBED_EMBEDDED_VERSION);
-		resizebarwin(selmon);
-		updatesystray();
+		setdirty(selmon, DirtySystray);
 	}
 
-	if (!XGetWindowAttributes(dpy, ev->window, &wa) || wa.override_redirect)
+	if (wintoclient(ev->window))
 		return;
-	if (!wintoclient(ev->window))
-		manage(ev->window, &wa);
+	prefetch(&pf, ev->window);
+	if (!fetchattrs(&pf, &wa) || wa.override_redirect)
+		dropprefetch(&pf);
+	else
+		manage(ev->window, &wa, &pf);
+}
+
+/* set c's urgency, keeping the per-tag counts and the urgency FIFO in step */
+void
+markurgent(Client *c, int urg)
+{
+	if (c->isurgent == urg)
+		return;
+	tagcount(c, -1);
+	c->isurgent = urg;
+	tagcount(c, 1);
+	if (urg) {
+		c->ci->uprev = urgenttail;
+		c->ci->unext = NULL;
+		if (urgenttail)
+			urgenttail->ci->unext = c;
+		else
+			urgent = c;
+		urgenttail = c;
+	} else {
+		if (c->ci->uprev)
+			c->ci->uprev->ci->unext = c->ci->unext;
+		else
+			urgent = c->ci->unext;
+		if (c->ci->unext)
+			c->ci->unext->ci->uprev = c->ci->uprev;
+		else
+			urgenttail = c->ci->uprev;
+		c->ci->unext = c->ci->uprev = NULL;
+	}
 }
 
 void
 monocle(Monitor *m)
 {
-	unsigned int n = 0;
+	int i;
 	Client *c;
 
-	for (c = m->clients; c; c = c->next)
-		if (ISVISIBLE(c))
-			n++;
-	if (n > 0) /* override layout symbol */
-		snprintf(m->ltsymbol, sizeof m->ltsymbol, "[%d]", n);
-	for (c = nexttiled(m->clients); c; c = nexttiled(c->next))
+	updatevis(m);
+	if (m->nvis > 0) /* override layout symbol */
+		snprintf(m->ltsymbol, sizeof m->ltsymbol, "[%d]", m->nvis);
+	for (i = 0; i < m->ntiled; i++) {
+		c = m->tiled[i];
 		resize(c, m->wx, m->wy, m->ww - 2 * c->bw, m->wh - 2 * c->bw, 0);
+	}
 }
 
 void
@@ -1813,10 +2725,11 @@ movemouse(const Arg *arg)
 		return;
 	if (c->isfullscreen) /* no support moving fullscreen windows by mouse */
 		return;
-	restack(selmon);
+	setdirty(selmon, DirtyStack);
+	commit();
 	ocx = c->x;
 	ocy = c->y;
-	int orig_opacity = c->opacity;
+	int orig_opacity = c->ci->opacity;
 	window_opacity_set(c, .42);
 	if (XGrabPointer(dpy, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
 		None, cursor[CurMove]->cursor, CurrentTime) != GrabSuccess)
@@ -1853,6 +2766,7 @@ movemouse(const Arg *arg)
 				resize(c, nx, ny, c->w, c->h, 1);
 			break;
 		}
+		commit();
 	} while (ev.type != ButtonRelease);
 	XUngrabPointer(dpy, CurrentTime);
 	window_opacity_set(c, orig_opacity);
@@ -1863,6 +2777,99 @@ movemouse(const Arg *arg)
 	}
 }
 
+/* put c on the MRU list of each of its tags, ordered by c->focused so the
+ * lists stay in focus-stack order */
+void
+mrulink(Client *c)
+{
+	Client **tc, *p;
+	unsigned int i;
+
+	if (!c->instack)
+		return; /* only stack members are listed */
+	for (i = 0; i < LENGTH(tags); i++) {
+		if (!(c->tags & 1 << i))
+			continue;
+		for (p = NULL, tc = &c->mon->pertag->mru[i];
+		     *tc && (*tc)->focused > c->focused;
+		     p = *tc, tc = &(*tc)->ci->tnext[i]);
+		c->ci->tprev[i] = p;
+		c->ci->tnext[i] = *tc;
+		if (*tc)
+			(*tc)->ci->tprev[i] = c;
+		*tc = c;
+	}
+}
+
+/* most recently focused visible client on m carrying none of the avoid
+ * tags; the head of each selected tag's list is usually the answer */
+Client *
+mrutop(Monitor *m, unsigned int avoid)
+{
+	Client *c, *best = NULL;
+	unsigned int i;
+
+	for (i = 0; i < LENGTH(tags); i++) {
+		if (!(m->tagset[m->seltags] & 1 << i) || avoid & 1 << i)
+			continue;
+		for (c = m->pertag->mru[i]; c && c->tags & avoid; c = c->ci->tnext[i]);
+		if (c && (!best || c->focused > best->focused))
+			best = c;
+	}
+	return best;
+}
+
+void
+mruunlink(Client *c)
+{
+	unsigned int i;
+
+	if (!c->instack)
+		return;
+	for (i = 0; i < LENGTH(tags); i++) {
+		if (!(c->tags & 1 << i))
+			continue;
+		if (c->ci->tprev[i])
+			c->ci->tprev[i]->ci->tnext[i] = c->ci->tnext[i];
+		else
+			c->mon->pertag->mru[i] = c->ci->tnext[i];
+		if (c->ci->tnext[i])
+			c->ci->tnext[i]->ci->tprev[i] = c->ci->tprev[i];
+		c->ci->tnext[i] = c->ci->tprev[i] = NULL;
+	}
+}
+
+Client *
+newclient(void)
+{
+	Client *c = palloc(&clientpool);
+
+	c->ci = palloc(&infopool);
+	return c;
+}
+
+/* mode 0: has a, 1: add, 2: remove; the change reaches the server in
+ * commit().  Returns whether a was in the set before. */
+Bool
+netstateop(Client *c, Atom a, int mode)
+{
+	Shadow *s = &c->ci->sh;
+	int i;
+
+	for (i = 0; i < s->nnetstate && s->netstate[i] != a; i++);
+	if (mode == 0 || (mode == 1) == (i < s->nnetstate))
+		return i < s->nnetstate;
+	if (mode == 1) {
+		if (s->nnetstate == MAXNETSTATE)
+			return False;
+		s->netstate[s->nnetstate++] = a;
+	} else
+		s->netstate[i] = s->netstate[--s->nnetstate];
+	s->netstatedirty = 1;
+	setdirty(c->mon, DirtyNetState);
+	return mode == 2;
+}
+
 Client *
 nexttiled(Client *c)
 {
@@ -1876,7 +2883,45 @@ pop(Client *c)
 	detach(c);
 	attach(c);
 	focus(c);
-	arrange(c->mon);
+	setdirty(c->mon, DirtyArrange);
+}
+
+unsigned int
+protobit(Atom a)
+{
+	return a == wmatom[WMDelete] ? ProtoDelete
+	     : a == wmatom[WMTakeFocus] ? ProtoTakeFocus : 0;
+}
+
+/* send every request manage() needs for w without waiting for any reply */
+void
+prefetch(Prefetch *pf, Window w)
+{
+	pf->attrs = xcb_get_window_attributes(xc, w);
+	pf->geom = xcb_get_geometry(xc, w);
+	pf->have = 0;
+	pf->prop[PfNormalHints] = xcb_get_property(xc, 0, w, XA_WM_NORMAL_HINTS, XA_WM_SIZE_HINTS, 0, 18);
+	pf->prop[PfNetWMName] = xcb_get_property(xc, 0, w, netatom[NetWMName], AnyPropertyType, 0, 1000000);
+	pf->prop[PfWMName] = xcb_get_property(xc, 0, w, XA_WM_NAME, AnyPropertyType, 0, 1000000);
+	pf->prop[PfPid] = xcb_get_property(xc, 0, w, netatom[NetWMPid], XA_CARDINAL, 0, 1);
+	pf->prop[PfTransient] = xcb_get_property(xc, 0, w, XA_WM_TRANSIENT_FOR, XA_WINDOW, 0, 1);
+	pf->prop[PfClass] = xcb_get_property(xc, 0, w, XA_WM_CLASS, XA_STRING, 0, 64);
+	pf->prop[PfState] = xcb_get_property(xc, 0, w, netatom[NetWMState], XA_ATOM, 0, MAXNETSTATE);
+	pf->prop[PfType] = xcb_get_property(xc, 0, w, netatom[NetWMWindowType], XA_ATOM, 0, 1);
+	pf->prop[PfHints] = xcb_get_property(xc, 0, w, XA_WM_HINTS, XA_WM_HINTS, 0, 9);
+	pf->prop[PfTags] = xcb_get_property(xc, 0, w, dwmatom[DWMTags], AnyPropertyType, 0, 1);
+	pf->prop[PfProtocols] = xcb_get_property(xc, 0, w, wmatom[WMProtocols], XA_ATOM, 0, 32);
+}
+
+/* the reply to pf's property request i, waited for on first use only */
+xcb_get_property_reply_t *
+prefetched(Prefetch *pf, int i)
+{
+	if (!(pf->have & 1 << i)) {
+		pf->reply[i] = xcb_get_property_reply(xc, pf->prop[i], NULL);
+		pf->have |= 1 << i;
+	}
+	return pf->reply[i];
 }
 
 void
@@ -1893,62 +2938,177 @@ propertynotify(XEvent *e)
 		}
 		else
 			updatesystrayiconstate(c, ev);
-		resizebarwin(selmon);
-		updatesystray();
+		setdirty(selmon, DirtySystray);
 	}
 
 	if ((ev->window == root) && (ev->atom == XA_WM_NAME))
 		updatestatus();
-	else if (ev->state == PropertyDelete)
+	else if (ev->atom == wmatom[WMProtocols] && (c = wintoclient(ev->window)))
+		updateprotocols(c); /* deleting it counts too */
+	else if (ev->state == PropertyDelete) {
+		/* seturgent() must not write back hints the client removed */
+		if (ev->atom == XA_WM_HINTS && (c = wintoclient(ev->window)))
+			c->ci->haswmh = 0;
 		return; /* ignore */
+	}
 	else if ((c = wintoclient(ev->window))) {
 		switch(ev->atom) {
 		default: break;
 		case XA_WM_TRANSIENT_FOR:
 			if (!c->isfloating && (XGetTransientForHint(dpy, c->win, &trans)) &&
-				(c->isfloating = (wintoclient(trans)) != NULL))
-				arrange(c->mon);
+				(c->isfloating = (wintoclient(trans)) != NULL)) {
+				c->mon->visvalid = 0;
+				setdirty(c->mon, DirtyArrange);
+			}
 			break;
 		case XA_WM_NORMAL_HINTS:
-			c->hintsvalid = 0;
+			c->ci->hintsvalid = 0;
 			break;
 		case XA_WM_HINTS:
 			updatewmhints(c);
-			drawbars();
+			setdirty(c->mon, DirtyTags);
 			break;
 		}
 		if (ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName]) {
 			updatetitle(c);
-			if (c == c->mon->sel)
-				drawbar(c->mon);
+			if (ISVISIBLE(c))
+				setdirty(c->mon, DirtyTitle);
 		}
 		if (ev->atom == netatom[NetWMWindowType])
 			updatewindowtype(c);
 	}
 }
 
+/* decode WM_NORMAL_HINTS like XGetWMNormalHints() */
+int
+propsizehints(xcb_get_property_reply_t *r, XSizeHints *size)
+{
+	int32_t *v;
+
+	/* pre-ICCCM clients send 15 fields, without base size and gravity */
+	if (!(v = propvalue(r, XA_WM_SIZE_HINTS, 32, 15)))
+		return 0;
+	size->flags = v[0] & (USPosition|USSize|PAllHints|PBaseSize|PWinGravity);
+	size->x = v[1];
+	size->y = v[2];
+	size->width = v[3];
+	size->height = v[4];
+	size->min_width = v[5];
+	size->min_height = v[6];
+	size->max_width = v[7];
+	size->max_height = v[8];
+	size->width_inc = v[9];
+	size->height_inc = v[10];
+	size->min_aspect.x = v[11];
+	size->min_aspect.y = v[12];
+	size->max_aspect.x = v[13];
+	size->max_aspect.y = v[14];
+	if (r->value_len >= 18) {
+		size->base_width = v[15];
+		size->base_height = v[16];
+		size->win_gravity = v[17];
+	} else {
+		size->flags &= ~(PBaseSize|PWinGravity);
+		size->base_width = size->base_height = size->win_gravity = 0;
+	}
+	return 1;
+}
+
+int
+proptext(xcb_get_property_reply_t *r, char *text, unsigned int size)
+{
+	XTextProperty name;
+
+	if (!text || size == 0)
+		return 0;
+	text[0] = '\0';
+	if (!r || r->type == None)
+		return 0;
+	name.value = xcb_get_property_value(r);
+	name.encoding = r->type;
+	name.format = r->format;
+	name.nitems = r->value_len;
+	return textpropcpy(&name, text, size);
+}
+
+/* the value of r if it has the given type and format and at least n items */
+void *
+propvalue(xcb_get_property_reply_t *r, Atom type, int format, unsigned int n)
+{
+	if (!r || (type != AnyPropertyType && r->type != type)
+	|| r->format != format || r->value_len < n)
+		return NULL;
+	return xcb_get_property_value(r);
+}
+
+/* decode WM_HINTS like XGetWMHints() */
+int
+propwmhints(xcb_get_property_reply_t *r, XWMHints *wmh)
+{
+	uint32_t *v;
+
+	if (!(v = propvalue(r, XA_WM_HINTS, 32, 8)))
+		return 0;
+	wmh->flags = v[0];
+	wmh->input = v[1];
+	wmh->initial_state = v[2];
+	wmh->icon_pixmap = v[3];
+	wmh->icon_window = v[4];
+	wmh->icon_x = v[5];
+	wmh->icon_y = v[6];
+	wmh->icon_mask = v[7];
+	wmh->window_group = r->value_len >= 9 ? v[8] : None;
+	return 1;
+}
+
+/* make root's prop hold w[0..n), which replaces *pub; an unchanged list
+ * costs nothing and one that grew at the end only sends the new tail */
+void
+publishlist(Atom prop, Window **pub, int *npub, Window *w, int n)
+{
+	int old = *npub;
+
+	if (n == old && (!n || !memcmp(w, *pub, n * sizeof(Window)))) {
+		suppressed++;
+		free(w);
+		return;
+	}
+	if (n > old && old > 0 && !memcmp(w, *pub, old * sizeof(Window)))
+		XChangeProperty(dpy, root, prop, XA_WINDOW, 32, PropModeAppend,
+			(unsigned char *)(w + old), n - old);
+	else
+		XChangeProperty(dpy, root, prop, XA_WINDOW, 32, PropModeReplace,
+			(unsigned char *)w, n);
+	free(*pub);
+	*pub = w;
+	*npub = n;
+}
+
 void
 pushstack(const Arg *arg)
 {
-	int i = stackpos(arg, 0);
-	Client *sel = selmon->sel, *c, *p;
+	int i = stackpos(arg, 0), j;
+	Client *sel = selmon->sel, *c;
 
-	if (i < 0)
+	if (i < 0 || !sel)
 		return;
 	else if (i == 0) {
 		detach(sel);
 		attach(sel);
 	}
 	else {
-		for (p = NULL, c = selmon->clients; c; p = c, c = c->next)
-			if (!(i -= (ISVISIBLE(c) && c != sel)))
-				break;
-		c = c ? c : p;
+		/* the i-th visible client other than sel, or the last one */
+		for (c = NULL, j = 0; j < selmon->nvis && i; j++)
+			if (selmon->vis[j] != sel) {
+				c = selmon->vis[j];
+				i--;
+			}
+		if (!c)
+			return;
 		detach(sel);
-		sel->next = c->next;
-		c->next = sel;
+		attachafter(sel, c);
 	}
-	arrange(selmon);
+	setdirty(selmon, DirtyArrange);
 }
 
 void
@@ -1981,7 +3141,8 @@ removesystrayicon(Client *i)
 	for (ii = &systray->icons; *ii && *ii != i; ii = &(*ii)->next);
 	if (ii)
 		*ii = i->next;
-	free(i);
+	windel(i->win);
+	freeclient(i);
 }
 
 void
@@ -2002,22 +3163,20 @@ resizebarwin(Monitor *m) {
 void
 resizeclient(Client *c, int x, int y, int w, int h)
 {
-	XWindowChanges wc;
-
-	c->x = wc.x = x;
-	c->y = wc.y = y;
-	c->w = wc.width = w;
-	c->h = wc.height = h;
-	wc.border_width = c->bw;
+	c->x = x;
+	c->y = y;
+	c->w = w;
+	c->h = h;
 	if ((!selmon->lt[selmon->sellt]->arrange || c->isfloating) && !c->isfullscreen) {
-		c->oldx = x;
-		c->oldy = y;
-		c->oldw = w;
-		c->oldh = h;
+		c->ci->oldx = x;
+		c->ci->oldy = y;
+		c->ci->oldw = w;
+		c->ci->oldh = h;
 	}
-	XConfigureWindow(dpy, c->win, CWX|CWY|CWWidth|CWHeight|CWBorderWidth, &wc);
-	configure(c);
-	XSync(dpy, False);
+	/* sent by commit(), so a client placed twice in one pass is
+	 * configured once and a layout costs no round trips */
+	c->geomdirty = 1;
+	setdirty(c->mon, DirtyGeom);
 }
 
 void
@@ -2033,11 +3192,12 @@ resizemouse(const Arg *arg)
 		return;
 	if (c->isfullscreen) /* no support resizing fullscreen windows by mouse */
 		return;
-	restack(selmon);
+	setdirty(selmon, DirtyStack);
+	commit();
 	ocx = c->x;
 	ocy = c->y;
 
-	int orig_opacity = c->opacity;
+	int orig_opacity = c->ci->opacity;
 	window_opacity_set(c, .42);
 	if (XGrabPointer(dpy, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
 		None, cursor[CurResize]->cursor, CurrentTime) != GrabSuccess)
@@ -2069,6 +3229,7 @@ resizemouse(const Arg *arg)
 				resize(c, c->x, c->y, nw, nh, 1);
 			break;
 		}
+		commit();
 	} while (ev.type != ButtonRelease);
 	XWarpPointer(dpy, None, c->win, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
 	XUngrabPointer(dpy, CurrentTime);
@@ -2089,47 +3250,159 @@ resizerequest(XEvent *e)
 
 	if ((i = wintosystrayicon(ev->window))) {
 		updatesystrayicongeom(i, ev->width, ev->height);
-		resizebarwin(selmon);
-		updatesystray();
+		setdirty(selmon, DirtySystray);
 	}
 }
 
 void
 restack(Monitor *m)
 {
-	Client *c;
-	XEvent ev;
-	XWindowChanges wc;
+	Client *c, **v;
+	Window *w;
+	int i, j, n, bar;
 
-	drawbar(m);
-	if (!m->sel)
+	if (m->sel && (m->sel->isfloating || !m->lt[m->sellt]->arrange || m->sel->raiseme)) {
+		m->sel->raised = ++raiseseq;
+		m->sel->raiseme = 0;
+	}
+	for (n = 0, c = m->stack; c; c = c->snext, n++);
+	v = ecalloc(n + 1, sizeof(Client *));
+	w = ecalloc(n + 2, sizeof(Window));
+	/* visible clients top down: by layer, tiled ones in focus order,
+	 * floating and fullscreen ones in the order they were raised */
+	for (n = 0, c = m->stack; c; c = c->snext) {
+		if (!ISVISIBLE(c))
+			continue;
+		for (i = n++; i > 0 && stackabove(c, v[i - 1]); i--)
+			v[i] = v[i - 1];
+		v[i] = c;
+	}
+	for (i = j = bar = 0; i <= n; i++) {
+		if (!bar && (i == n || clientlayer(v[i]) < LayerBar)) {
+			if (showsystray && systray && systraytomon(m) == m)
+				w[j++] = systray->win;
+			w[j++] = m->barwin;
+			bar = 1;
+		}
+		if (i < n)
+			w[j++] = v[i]->win;
+	}
+	free(v);
+	if (j == m->nstacking && !memcmp(w, m->stacking, j * sizeof(Window))) {
+		free(w);
 		return;
-	if (m->sel->isfloating || !m->lt[m->sellt]->arrange || m->sel->raiseme) {
-		if (!m->sel->isdesktop) XRaiseWindow(dpy, m->sel->win);
-		if (m->sel->raiseme) m->sel->raiseme = 0;
 	}
-	if (m->lt[m->sellt]->arrange) {
-		wc.stack_mode = Below;
-		wc.sibling = m->barwin;
-		for (c = m->stack; c; c = c->snext)
-			if (!c->isfloating && ISVISIBLE(c)) {
-				XConfigureWindow(dpy, c->win, CWSibling|CWStackMode, &wc);
-				wc.sibling = c->win;
-			}
+	/* XRestackWindows() keeps the first window where it is */
+	if (w[0] != m->barwin && (!systray || w[0] != systray->win))
+		XRaiseWindow(dpy, w[0]);
+	XRestackWindows(dpy, w, j);
+	free(m->stacking);
+	m->stacking = w;
+	m->nstacking = j;
+}
+
+/* the rules whose class and instance patterns match, remembered per
+ * (class, instance) so repeat windows skip matching; titles are checked
+ * by applyrules() */
+RuleMemo *
+rulememo(const char *class, const char *instance)
+{
+	RuleMemo *rm;
+	const char *p;
+	unsigned int h = 5381;
+	int f, i, j, n = 0, r, need;
+	size_t lc = strlen(class) + 1, li = strlen(instance) + 1;
+
+	for (p = class; *p; p++)
+		h = h * 33 + (unsigned char)*p;
+	for (p = instance, h *= 33; *p; p++)
+		h = h * 33 + (unsigned char)*p;
+	h %= LENGTH(rulememos);
+	for (rm = rulememos[h]; rm; rm = rm->next)
+		if (!strcmp(rm->class, class) && !strcmp(rm->instance, instance))
+			return rm;
+
+	for (f = RuleClass; f <= RuleInstance; f++) {
+		acscan(&matcher[f], f == RuleClass ? class : instance);
+		for (j = 0; j < matcher[f].nhits; j++)
+			for (r = matcher[f].first[matcher[f].hits[j]]; r >= 0; r = rulekeys[r].next[f])
+				if (rulehits[r]++ == 0)
+					rulecand[n++] = r;
 	}
-	XSync(dpy, False);
-	while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
+	for (i = j = 0; j < n; j++) {
+		r = rulecand[j];
+		need = (rulekeys[r].pat[RuleClass] >= 0) + (rulekeys[r].pat[RuleInstance] >= 0);
+		if (rulehits[r] == need)
+			rulecand[i++] = r;
+		rulehits[r] = 0;
+	}
+	for (n = i, j = 0; j < nopenrules; j++)
+		rulecand[n++] = openrules[j];
+	qsort(rulecand, n, sizeof(int), cmpint);
+
+	if (nrulememos >= 256)
+		droprulememos();
+	rm = ecalloc(1, sizeof(RuleMemo) + n * sizeof(int) + lc + li);
+	rm->n = n;
+	memcpy(rm->rules, rulecand, n * sizeof(int));
+	rm->class = (char *)(rm->rules + n);
+	rm->instance = rm->class + lc;
+	memcpy(rm->class, class, lc);
+	memcpy(rm->instance, instance, li);
+	rm->next = rulememos[h];
+	rulememos[h] = rm;
+	nrulememos++;
+	return rm;
 }
 
 void
 run(void)
 {
-	XEvent ev;
+	static XEvent ev[BATCHSIZE];
+	struct epoll_event pev[8];
+	uint64_t expired;
+	Watch *w;
+	int i, n, pending;
+
 	/* main event loop */
+	commit();
 	XSync(dpy, False);
-	while (running && !XNextEvent(dpy, &ev))
-		if (handler[ev.type])
-			handler[ev.type](&ev); /* call handler */
+	while (running) {
+		/* XPending() flushes our requests and reads whatever the
+		 * server has sent, so only sleep once it reports nothing:
+		 * the X fd may be quiet while events sit in Xlib's queue */
+		if ((pending = XPending(dpy))) {
+			/* drain the queue, but leave whatever follows a button press
+			 * to the pointer grabs in movemouse() and resizemouse() */
+			n = 0;
+			do
+				XNextEvent(dpy, &ev[n]);
+			while (ev[n++].type != ButtonPress && n < BATCHSIZE && XPending(dpy));
+			coalesce(ev, n);
+			dispatch(ev, n);
+			commit();
+#ifdef LISTDEBUG
+			checklists();
+#endif
+		} else if (idlework) {
+			idle(NULL);
+			commit(); /* idle() may queue _NET_WM_STATE changes */
+			continue;
+		}
+		/* poll the other watches between batches too, so a flood of
+		 * events cannot starve timers and signals */
+		if ((n = epoll_wait(epfd, pev, LENGTH(pev), pending ? 0 : -1)) < 0 && errno != EINTR)
+			die("epoll_wait:");
+		for (i = 0; i < n && running; i++) {
+			w = pev[i].data.ptr;
+			if (w->istimer)
+				while (read(w->fd, &expired, sizeof(expired)) > 0);
+			if (w->func)
+				w->func(w);
+		}
+		if (n > 0)
+			commit();
+	}
 }
 
 void
@@ -2137,26 +3410,54 @@ scan(void)
 {
 	unsigned int i, num;
 	Window d1, d2, *wins = NULL;
-	XWindowAttributes wa;
-
-	if (XQueryTree(dpy, root, &d1, &d2, &wins, &num)) {
-		for (i = 0; i < num; i++) {
-			if (!XGetWindowAttributes(dpy, wins[i], &wa)
-			|| wa.override_redirect || XGetTransientForHint(dpy, wins[i], &d1))
-				continue;
-			if (wa.map_state == IsViewable || getstate(wins[i]) == IconicState)
-				manage(wins[i], &wa);
-		}
-		for (i = 0; i < num; i++) { /* now the transients */
-			if (!XGetWindowAttributes(dpy, wins[i], &wa))
-				continue;
-			if (XGetTransientForHint(dpy, wins[i], &d1)
-			&& (wa.map_state == IsViewable || getstate(wins[i]) == IconicState))
-				manage(wins[i], &wa);
-		}
-		if (wins)
-			XFree(wins);
+	XWindowAttributes *wa;
+	Prefetch *pf;
+	xcb_get_property_cookie_t *state;
+	xcb_get_property_reply_t *r;
+	uint32_t *v;
+	char *adopt; /* 0: skip, 1: adopt now, 2: adopt with the transients */
+	long st;
+
+	if (!XQueryTree(dpy, root, &d1, &d2, &wins, &num))
+		return;
+	wa = ecalloc(num, sizeof(XWindowAttributes));
+	pf = ecalloc(num, sizeof(Prefetch));
+	state = ecalloc(num, sizeof(xcb_get_property_cookie_t));
+	adopt = ecalloc(num, 1);
+
+	/* send everything for every window before waiting for anything */
+	for (i = 0; i < num; i++) {
+		prefetch(&pf[i], wins[i]);
+		state[i] = xcb_get_property(xc, 0, wins[i], wmatom[WMState], wmatom[WMState], 0, 2);
 	}
+	for (i = 0; i < num; i++) {
+		r = xcb_get_property_reply(xc, state[i], NULL);
+		st = (v = propvalue(r, wmatom[WMState], 32, 1)) ? (long)*v : -1;
+		free(r);
+		if (fetchattrs(&pf[i], &wa[i]) && !wa[i].override_redirect
+		&& (wa[i].map_state == IsViewable || st == IconicState))
+			adopt[i] = propvalue(prefetched(&pf[i], PfTransient), XA_WINDOW, 32, 1) ? 2 : 1;
+	}
+
+	/* build every client first, then focus and publish once */
+	scanning = 1;
+	for (i = 0; i < num; i++)
+		if (adopt[i] == 1)
+			manage(wins[i], &wa[i], &pf[i]);
+	for (i = 0; i < num; i++) /* now the transients */
+		if (adopt[i] == 2)
+			manage(wins[i], &wa[i], &pf[i]);
+		else if (!adopt[i])
+			dropprefetch(&pf[i]);
+	scanning = 0;
+	focus(NULL);
+
+	free(adopt);
+	free(state);
+	free(pf);
+	free(wa);
+	if (wins)
+		XFree(wins);
 }
 
 void
@@ -2167,6 +3468,7 @@ sendmon(Client *c, Monitor *m)
 	unfocus(c, 1);
 	detach(c);
 	detachstack(c);
+	setdirty(c->mon, DirtyArrange);
 	c->mon = m;
 	c->tags = m->tagset[m->seltags]; /* assign tags of target monitor */
 	if (!attach_bottom_p)
@@ -2175,7 +3477,26 @@ sendmon(Client *c, Monitor *m)
 		attachbottom(c);
 	attachstack(c);
 	focus(NULL);
-	arrange(NULL);
+	setdirty(m, DirtyArrange);
+}
+
+void
+setactivewindow(Window w)
+{
+	if (SHADOWED(&rootsh, ShActive, active, w))
+		return;
+	if (w)
+		XChangeProperty(dpy, root, netatom[NetActiveWindow], XA_WINDOW, 32,
+			PropModeReplace, (unsigned char *)&w, 1);
+	else
+		XDeleteProperty(dpy, root, netatom[NetActiveWindow]);
+}
+
+void
+setborder(Client *c, unsigned long pixel)
+{
+	if (!SHADOWED(&c->ci->sh, ShBorder, border, pixel))
+		XSetWindowBorder(dpy, c->win, pixel);
 }
 
 void
@@ -2183,10 +3504,29 @@ setclientstate(Client *c, long state)
 {
 	long data[] = { state, None };
 
+	if (SHADOWED(&c->ci->sh, ShState, state, state))
+		return;
 	XChangeProperty(dpy, c->win, wmatom[WMState], wmatom[WMState], 32,
 		PropModeReplace, (unsigned char *)data, 2);
 }
 
+void
+setdesktopprop(Client *c, long desktop)
+{
+	if (!SHADOWED(&c->ci->sh, ShDesktop, desktop, desktop))
+		XChangeProperty(dpy, c->win, netatom[NetWMDesktop], XA_CARDINAL, 32,
+			PropModeReplace, (unsigned char *)&desktop, 1);
+}
+
+void
+setdirty(Monitor *m, unsigned int bits)
+{
+	if (m)
+		m->dirty |= bits;
+	else for (m = mons; m; m = m->next)
+		m->dirty |= bits;
+}
+
 void
 setdirs(const Arg *arg)
 {
@@ -2198,7 +3538,7 @@ setdirs(const Arg *arg)
 		areas[i].dir = ISINC(dirs[i]) ?
 			MOD((int)areas[i].dir + GETINC(dirs[i]), n) : TRUNC(dirs[i], 0, n - 1);
 	}
-	arrange(selmon);
+	setdirty(selmon, DirtyLayout);
 }
 
 void
@@ -2210,43 +3550,34 @@ setfacts(const Arg *arg) {
 	for (i = 0; i < 3; i++)
 		areas[i].fact = TRUNC(ISINC(facts[i]) ?
 			areas[i].fact + GETINC(facts[i]) : facts[i], 0.1, 10);
-	arrange(selmon);
+	setdirty(selmon, DirtyLayout);
 }
 
 int
-sendevent(Window w, Atom proto, int mask, long d0, long d1, long d2, long d3, long d4)
+sendevent(Window w, Atom type, int mask, long d0, long d1, long d2, long d3, long d4)
 {
-	int n;
-	Atom *protocols, mt;
-	int exists = 0;
 	XEvent ev;
 
-	if (proto == wmatom[WMTakeFocus] || proto == wmatom[WMDelete]) {
-		mt = wmatom[WMProtocols];
-		if (XGetWMProtocols(dpy, w, &protocols, &n)) {
-			while (!exists && n--)
-				exists = protocols[n] == proto;
-			XFree(protocols);
-		}
-	}
-	else {
-		exists = 1;
-		mt = proto;
-	}
+	ev.type = ClientMessage;
+	ev.xclient.window = w;
+	ev.xclient.message_type = type;
+	ev.xclient.format = 32;
+	ev.xclient.data.l[0] = d0;
+	ev.xclient.data.l[1] = d1;
+	ev.xclient.data.l[2] = d2;
+	ev.xclient.data.l[3] = d3;
+	ev.xclient.data.l[4] = d4;
+	XSendEvent(dpy, w, False, mask, &ev);
+	return 1;
+}
 
-	if (exists) {
-		ev.type = ClientMessage;
-		ev.xclient.window = w;
-		ev.xclient.message_type = mt;
-		ev.xclient.format = 32;
-		ev.xclient.data.l[0] = d0;
-		ev.xclient.data.l[1] = d1;
-		ev.xclient.data.l[2] = d2;
-		ev.xclient.data.l[3] = d3;
-		ev.xclient.data.l[4] = d4;
-		XSendEvent(dpy, w, False, mask, &ev);
-	}
-	return exists;
+/* send a WM_PROTOCOLS message, if c said it takes proto */
+int
+sendprotocol(Client *c, Atom proto, long time)
+{
+	if (!(c->ci->protocols & protobit(proto)))
+		return 0;
+	return sendevent(c->win, wmatom[WMProtocols], NoEventMask, proto, time, 0, 0, 0);
 }
 
 void
@@ -2260,6 +3591,8 @@ set_net_current_desktop()
 			if (++ntags > 1)
 				break;
 		}
+	if (SHADOWED(&rootsh, ShDesktop, desktop, j))
+		return;
 	XChangeProperty(dpy, root, netatom[NetCurrentDesktop], XA_CARDINAL, 32, PropModeReplace, (unsigned char *) &j, 1);
 }
 
@@ -2268,12 +3601,9 @@ setfocus(Client *c)
 {
 	if (!c->neverfocus)
 		XSetInputFocus(dpy, c->win, RevertToPointerRoot, CurrentTime);
-	XChangeProperty(dpy, root, netatom[NetActiveWindow], XA_WINDOW, 32,
-		PropModeReplace, (unsigned char *)&c->win, 1);
-	sendevent(c->win, wmatom[WMTakeFocus], NoEventMask,
-		  wmatom[WMTakeFocus],
-		  (ISVISIBLE(c) ?
-		   Last_Event_Time : CurrentTime), 0, 0, 0);
+	setactivewindow(c->win);
+	sendprotocol(c, wmatom[WMTakeFocus],
+		     ISVISIBLE(c) ? Last_Event_Time : CurrentTime);
 }
 
 void
@@ -2282,29 +3612,30 @@ setfullscreen(Client *c, int fullscreen)
 	if (fullscreen && !c->isfullscreen) {
 //		XChangeProperty(dpy, c->win, netatom[NetWMState], XA_ATOM, 32,
 //			PropModeReplace, (unsigned char*)&netatom[NetWMFullscreen], 1);
-		atompropop(c->win, netatom[NetWMState],
-			   netatom[NetWMFullscreen], 1); // add
+		netstateop(c, netatom[NetWMFullscreen], 1);
 		c->isfullscreen = 1;
-		c->oldstate = c->isfloating;
-		c->oldbw = c->bw;
+		c->ci->oldstate = c->isfloating;
+		c->ci->oldbw = c->bw;
 		c->bw = 0;
 		c->isfloating = 1;
+		c->mon->visvalid = 0;
 		resizeclient(c, c->mon->mx, c->mon->my, c->mon->mw, c->mon->mh);
-		if (!c->isdesktop) XRaiseWindow(dpy, c->win);
+		c->raised = ++raiseseq;
+		setdirty(c->mon, DirtyStack);
 	} else if (!fullscreen && c->isfullscreen){
 //		XChangeProperty(dpy, c->win, netatom[NetWMState], XA_ATOM, 32,
 //			PropModeReplace, (unsigned char*)0, 0);
-		atompropop(c->win, netatom[NetWMState],
-			   netatom[NetWMFullscreen], 2); //delete
+		netstateop(c, netatom[NetWMFullscreen], 2);
 		c->isfullscreen = 0;
-		c->isfloating = c->oldstate;
-		c->bw = c->oldbw;
-		c->x = c->oldx;
-		c->y = c->oldy;
-		c->w = c->oldw;
-		c->h = c->oldh;
+		c->isfloating = c->ci->oldstate;
+		c->mon->visvalid = 0;
+		c->bw = c->ci->oldbw;
+		c->x = c->ci->oldx;
+		c->y = c->ci->oldy;
+		c->w = c->ci->oldw;
+		c->h = c->ci->oldh;
 		resizeclient(c, c->x, c->y, c->w, c->h);
-		arrange(c->mon);
+		setdirty(c->mon, DirtyArrange);
 	}
 }
 
@@ -2317,9 +3648,9 @@ setlayout(const Arg *arg)
 		selmon->lt[selmon->sellt] = selmon->pertag->ltidxs[selmon->pertag->curtag][selmon->sellt] = (Layout *)arg->v;
 	strncpy(selmon->ltsymbol, selmon->lt[selmon->sellt]->symbol, sizeof selmon->ltsymbol);
 	if (selmon->sel || (lose_focus && selmon->clients)) // lose_focus: loose
-		arrange(selmon);
+		setdirty(selmon, DirtyArrange);
 	else
-		drawbar(selmon);
+		setdirty(selmon, DirtyTags);
 }
 
 /* arg > 1.0 will set mfact absolutely * /
@@ -2334,35 +3665,45 @@ setmfact(const Arg *arg)
 	if (f < 0.05 || f > 0.95)
 		return;
 	selmon->mfact = selmon->pertag->mfacts[selmon->pertag->curtag] = f;
-	arrange(selmon);
+	setdirty(selmon, DirtyLayout);
 }
 */
 
 void
-settagsprop(Window w, unsigned int _tags)
+settagsprop(Client *c, unsigned int _tags)
 {
 	unsigned int v[1] = { _tags };
 	XTextProperty p;
+	if (SHADOWED(&c->ci->sh, ShTags, tags, _tags))
+		return;
 	p.value = (unsigned char *)v;
 	p.encoding = XA_CARDINAL;
 	p.format = 32;
 	p.nitems = LENGTH(v);
-	XSetTextProperty(dpy, w, &p, dwmatom[DWMTags]);
+	XSetTextProperty(dpy, c->win, &p, dwmatom[DWMTags]);
 	int i, j = 0, ntags = 0;
 	for (i = 0; i < LENGTH(tags); i++)
 		if (_tags & (1 << i)) {
 			j = i;
 			if (++ntags > 1) break;
 		}
-	unsigned long x = -1; // all desktops
-	if (ntags == 1) x = j;
-	XChangeProperty(dpy, w, netatom[NetWMDesktop], XA_CARDINAL, 32,
-			PropModeReplace,
-			(unsigned char *) &x, 1);
+	setdesktopprop(c, ntags == 1 ? j : -1); // -1: all desktops
 	// add _NET_WM_STATE_SKIP_TASKBAR to _NET_WM_STATE if the
 	// window is displayed on all tags. Remove it if not.
-	atompropop(w, netatom[NetWMState], netatom[NetWMSkipTaskbar],
-		   (_tags == TAGMASK) ? 1 : 2);
+	netstateop(c, netatom[NetWMSkipTaskbar], (_tags == TAGMASK) ? 1 : 2);
+}
+
+/* arm w to fire after ms, then every interval ms; ms == 0 disarms it */
+void
+settimer(Watch *w, unsigned int ms, unsigned int interval)
+{
+	struct itimerspec its = {
+		.it_value = { ms / 1000, ms % 1000 * 1000000L },
+		.it_interval = { interval / 1000, interval % 1000 * 1000000L },
+	};
+
+	if (timerfd_settime(w->fd, 0, &its, NULL) < 0)
+		die("timerfd_settime:");
 }
 
 void
@@ -2370,23 +3711,27 @@ setup(void)
 {
 	int i;
 	XSetWindowAttributes wa;
-	Atom utf8string;
-#ifdef HAVE_USE_SIGACTION_SIGCHLD
-	struct sigaction sa;
-
-	/* do not transform children into zombies when they terminate */
-	sigemptyset(&sa.sa_mask);
-	sa.sa_flags = SA_NOCLDSTOP | SA_NOCLDWAIT | SA_RESTART;
-	sa.sa_handler = SIG_IGN;
-	sigaction(SIGCHLD, &sa, NULL);
-
+	sigset_t mask;
+	int fd;
+
+	/* everything run() waits on is multiplexed through one epoll set;
+	 * SIGCHLD is blocked and delivered through a signalfd instead */
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		die("epoll_create1:");
+	xwatch = addwatch(ConnectionNumber(dpy), NULL, NULL);
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+		die("sigprocmask:");
+	if ((fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+		die("signalfd:");
+	sigwatch = addwatch(fd, sigchld, NULL);
+	idletimer = addtimer(idle, NULL);
 	/* clean up any zombies (inherited from .xinitrc etc) immediately */
-	while (waitpid(-1, NULL, WNOHANG) > 0);
-#else
-	sigchld(0);
-#endif
+	sigchld(sigwatch);
 
 	/* init screen */
+	xc = XGetXCBConnection(dpy);
 	screen = DefaultScreen(dpy);
 	sw = DisplayWidth(dpy, screen);
 	sh = DisplayHeight(dpy, screen);
@@ -2420,6 +3765,7 @@ setup(void)
 	netatom[NetWMWindowTypeDialog] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
 	netatom[NetWMWindowTypeDesktop] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DESKTOP", False);
 	netatom[NetClientList] = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
+	netatom[NetClientListStacking] = XInternAtom(dpy, "_NET_CLIENT_LIST_STACKING", False);
 	netatom[NetWMPid] = XInternAtom(dpy, "_NET_WM_PID", False);
 	netatom[NetDesktopNames] = XInternAtom(dpy, "_NET_DESKTOP_NAMES", False);
 	netatom[NetNumberOfDesktops] = XInternAtom(dpy, "_NET_NUMBER_OF_DESKTOPS", False);
@@ -2438,6 +3784,8 @@ setup(void)
 	scheme = ecalloc(LENGTH(colors), sizeof(Clr *));
 	for (i = 0; i < LENGTH(colors); i++)
 		scheme[i] = drw_scm_create(drw, colors[i], 3, alpha_scheme);
+	/* index rules */
+	compilerules();
 	/* init system tray */
 	updatesystray();
 	/* init bars */
@@ -2459,31 +3807,9 @@ setup(void)
 	XChangeProperty(dpy, root, netatom[NetSupported], XA_ATOM, 32,
 		PropModeReplace, (unsigned char *) netatom, NetLast);
 	XDeleteProperty(dpy, root, netatom[NetClientList]);
+	XDeleteProperty(dpy, root, netatom[NetClientListStacking]);
 
-	/* initialize desktop names */
-	{
-		unsigned long i = LENGTH(tags);
-		XChangeProperty(dpy, root, netatom[NetNumberOfDesktops],
-				XA_CARDINAL, 32, PropModeReplace,
-				(unsigned char *) &i, 1);
-		XDeleteProperty(dpy, root, netatom[NetDesktopNames]);
-		char buf[26 * LENGTH(tags)], *p;
-		int tlen = 0;
-		for(i = 0, p = buf; i < LENGTH(tags); i++) {
-			const char *str; int len;
-			str = "Desktop "; len = strlen(str);
-			strcpy(p, str); p += len; tlen += len;
-			str = tags[i]; len = strlen(str);
-			strcpy(p, str); p += len; tlen += len;
-			if (*p != 0 || !(tlen < sizeof(buf) - 2)) {
-				die("ASSERT ERROR\n");
-			}
-			p++; tlen++;
-		}
-		XChangeProperty(dpy, root, netatom[NetDesktopNames],
-				utf8string, 8, PropModeReplace,
-				(unsigned char *) buf, tlen);
-	}
+	defer(IdleDesktopNames);
 	/* select events */
 	wa.cursor = cursor[CurNormal]->cursor;
 
@@ -2502,47 +3828,65 @@ setup(void)
 void
 seturgent(Client *c, int urg)
 {
-	XWMHints *wmh;
+	XWMHints *wmh = &c->ci->wmh;
+	long flags;
 
-	c->isurgent = urg;
-	if (!(wmh = XGetWMHints(dpy, c->win)))
+	urg = !!urg;
+	if (c->isurgent == urg)
+		return;
+	markurgent(c, urg);
+	if (!c->ci->haswmh)
 		return;
-	wmh->flags = urg ? (wmh->flags | XUrgencyHint) : (wmh->flags & ~XUrgencyHint);
+	flags = urg ? (wmh->flags | XUrgencyHint) : (wmh->flags & ~XUrgencyHint);
+	if (flags == wmh->flags)
+		return;
+	wmh->flags = flags;
 	XSetWMHints(dpy, c->win, wmh);
-	XFree(wmh);
 }
 
 void
 showhide(Client *c)
 {
-	if (!c)
-		return;
-	if (ISVISIBLE(c)) {
-		/* show clients top down */
-		XMoveWindow(dpy, c->win, c->x, c->y);
+	Client *t, **hide;
+	int n;
+
+	for (n = 0, t = c; t; t = t->snext, n++);
+	hide = ecalloc(n + 1, sizeof(Client *));
+	/* show clients top down, only moving those that were hidden */
+	for (n = 0; c; c = c->snext) {
+		if (!ISVISIBLE(c)) {
+			hide[n++] = c;
+			continue;
+		}
+		if (c->hidden) {
+			XMoveWindow(dpy, c->win, c->x, c->y);
+			c->hidden = 0;
+		}
 		if ((!c->mon->lt[c->mon->sellt]->arrange || c->isfloating) && !c->isfullscreen) {
 			if (c->isfloating)
 				resize(c, c->x, c->y, c->w, c->h, 0);
 			else
-				resize(c, c->oldx, c->oldy, c->oldw, c->oldh, 0);
+				resize(c, c->ci->oldx, c->ci->oldy, c->ci->oldw, c->ci->oldh, 0);
 		}
-		showhide(c->snext);
-	} else {
-		/* hide clients bottom up */
-		showhide(c->snext);
-		XMoveWindow(dpy, c->win, c->x + 2 * sw, c->y);
 	}
+	/* hide clients bottom up */
+	while (n--)
+		if (hide[n]->hidden != 1) {
+			XMoveWindow(dpy, hide[n]->win, hide[n]->x + 2 * sw, hide[n]->y);
+			hide[n]->hidden = 1;
+		}
+	free(hide);
 }
 
-#ifndef HAVE_USE_SIGACTION_SIGCHLD
 void
-sigchld(int unused)
+sigchld(Watch *w)
 {
-	if (signal(SIGCHLD, sigchld) == SIG_ERR)
-		die("can't install SIGCHLD handler:");
+	struct signalfd_siginfo si;
+
+	/* pending SIGCHLDs merge, so reap until nothing is left */
+	while (read(w->fd, &si, sizeof(si)) > 0);
 	while (0 < waitpid(-1, NULL, WNOHANG));
 }
-#endif
 
 void
 spawn(const Arg *arg)
@@ -2560,12 +3904,22 @@ spawn(const Arg *arg)
 		sa.sa_flags = 0;
 		sa.sa_handler = SIG_DFL;
 		sigaction(SIGCHLD, &sa, NULL);
+		sigprocmask(SIG_SETMASK, &sa.sa_mask, NULL);
 
 		execvp(((char **)arg->v)[0], (char **)arg->v);
 		die("dwm: execvp '%s' failed:", ((char **)arg->v)[0]);
 	}
 }
 
+/* whether a belongs above b in restack() */
+int
+stackabove(Client *a, Client *b)
+{
+	int la = clientlayer(a), lb = clientlayer(b);
+
+	return la > lb || (la == lb && la != LayerTiled && a->raised > b->raised);
+}
+
 int
 stackpos(const Arg *arg, int excludep) {
 	int n, i;
@@ -2584,30 +3938,29 @@ stackpos(const Arg *arg, int excludep) {
 	if (!selmon->clients)
 		return -1;
 
-#define Y_ISVISIBLE(C) ((excludep ? X_ISVISIBLE(C) : ISVISIBLE(C)))
+	updatevis(selmon);
+	n = excludep ? selmon->nxvis : selmon->nvis;
 	if (arg->i == PREVSEL) {
 		if (!excludep) fprintf(stderr, "stackpos PREVSEL wtf\n");
 		for (l = selmon->stack; l && (!ISVISIBLE(l) || (!excludep || l == selmon->sel)); l = l->snext);
 		if (!l)
 			return -1;
-		for (i = 0, c = selmon->clients; c != l; i += ISVISIBLE(c) ? 1 : 0, c = c->next);
-		return i;
+		return l->vispos;
 	}
 	else if (ISINC(arg->i)) {
 		if (!lose_focus && !selmon->sel)
 			return -1;
-		for (i = 0, c = selmon->clients; c != selmon->sel; i += Y_ISVISIBLE(c) ? 1 : 0, c = c->next);
-		for (n = i; c; n += Y_ISVISIBLE(c) ? 1 : 0, c = c->next);
+		if (!(c = selmon->sel))
+			i = n;
+		else
+			i = excludep ? c->xvispos : c->vispos;
 		 // avoid cornercase division by 0
 		return n == 0 ? 0 : MOD(i + GETINC(arg->i), n);
 	}
-	else if (arg->i < 0) {
-		for (i = 0, c = selmon->clients; c; i += Y_ISVISIBLE(c) ? 1 : 0, c = c->next);
-		return MAX(i + arg->i, 0);
-	}
+	else if (arg->i < 0)
+		return MAX(n + arg->i, 0);
 	else
 		return arg->i;
-#undef Y_ISVISIBLE
 }
 
 Monitor *
@@ -2630,10 +3983,39 @@ void
 tag(const Arg *arg)
 {
 	if (selmon->sel && arg->ui & TAGMASK) {
+		tagcount(selmon->sel, -1);
+		mruunlink(selmon->sel);
 		selmon->sel->tags = arg->ui & TAGMASK;
-		settagsprop(selmon->sel->win, selmon->sel->tags);
+		mrulink(selmon->sel);
+		tagcount(selmon->sel, 1);
+		selmon->visvalid = 0;
+		defertags(selmon->sel);
 		focus(NULL);
-		arrange(selmon);
+		setdirty(selmon, DirtyArrange);
+	}
+}
+
+/* add (d = 1) or take (d = -1) c's tags and urgency to or from its
+ * monitor's per-tag counts; a no-op while c is not in the client list */
+void
+tagcount(Client *c, int d)
+{
+	Monitor *m = c->mon;
+	unsigned int i;
+
+	if (!m || !c->inclients)
+		return;
+	for (i = 0; i < LENGTH(tags); i++) {
+		if (!(c->tags & 1 << i))
+			continue;
+		if (c->tags != TAGMASK && (m->pertag->nclients[i] += d))
+			m->occ |= 1 << i;
+		else if (c->tags != TAGMASK)
+			m->occ &= ~(1 << i);
+		if (c->isurgent && (m->pertag->nurgent[i] += d))
+			m->urg |= 1 << i;
+		else if (c->isurgent)
+			m->urg &= ~(1 << i);
 	}
 }
 
@@ -2659,8 +4041,8 @@ tile(Monitor *m)
 		(char[]){ '-', '|' }[ma->dir],
 		(char[]){ '-', '|' }[sa->dir]);
 	/* calculate number of clients */
-	for (n = 0, c = nexttiled(m->clients); c; c = nexttiled(c->next), n++);
-	if (n == 0)
+	updatevis(m);
+	if ((n = m->ntiled) == 0)
 		return;
 	ma->n = MIN(n, m->nmaster), sa->n = n - ma->n;
 	/* calculate area rectangles */
@@ -2690,7 +4072,8 @@ tile(Monitor *m)
 	int ax, ay;
 
 	/* tile clients */
-	for (c = nexttiled(m->clients), i = 0; i < n; c = nexttiled(c->next), i++) {
+	for (i = 0; i < n; i++) {
+		c = m->tiled[i];
 		if (i == 0 || i == ma->n) {
 			a = (i == 0) ? ma : sa;
 			f = (a->n > 1) ? a->fact / (a->fact + a->n - 1) : 1;
@@ -2795,7 +4178,7 @@ togglebar(const Arg *arg)
 		}
 		XConfigureWindow(dpy, systray->win, CWY, &wc);
 	}
-	arrange(selmon);
+	setdirty(selmon, DirtyArrange);
 }
 
 void
@@ -2814,16 +4197,17 @@ togglefloating(const Arg *arg)
 //	if (selmon->sel->isfullscreen) /* no support for fullscreen windows */
 //		return;
 	selmon->sel->isfloating = !selmon->sel->isfloating || selmon->sel->isfixed;
+	selmon->visvalid = 0;
 	if (selmon->sel->isfloating)
-		resize(selmon->sel, selmon->sel->oldx, selmon->sel->oldy,
-		       selmon->sel->oldw, selmon->sel->oldh, 0);
+		resize(selmon->sel, selmon->sel->ci->oldx, selmon->sel->ci->oldy,
+		       selmon->sel->ci->oldw, selmon->sel->ci->oldh, 0);
 	if (!selmon->sel->isfloating && !selmon->sel->isfullscreen) {
-		selmon->sel->oldx = selmon->sel->x;
-		selmon->sel->oldy = selmon->sel->y;
-		selmon->sel->oldw = selmon->sel->w;
-		selmon->sel->oldh = selmon->sel->h;
+		selmon->sel->ci->oldx = selmon->sel->x;
+		selmon->sel->ci->oldy = selmon->sel->y;
+		selmon->sel->ci->oldw = selmon->sel->w;
+		selmon->sel->ci->oldh = selmon->sel->h;
 	}
-	arrange(selmon);
+	setdirty(selmon, DirtyArrange);
 }
 
 void
@@ -2835,10 +4219,15 @@ toggletag(const Arg *arg)
 		return;
 	newtags = selmon->sel->tags ^ (arg->ui & TAGMASK);
 	if (newtags) {
+		tagcount(selmon->sel, -1);
+		mruunlink(selmon->sel);
 		selmon->sel->tags = newtags;
-		settagsprop(selmon->sel->win, selmon->sel->tags);
+		mrulink(selmon->sel);
+		tagcount(selmon->sel, 1);
+		selmon->visvalid = 0;
+		defertags(selmon->sel);
 		focus(NULL);
-		arrange(selmon);
+		setdirty(selmon, DirtyArrange);
 	}
 }
 
@@ -2850,6 +4239,7 @@ toggleview(const Arg *arg)
 
 	if (newtagset) {
 		selmon->tagset[selmon->seltags] = newtagset;
+		selmon->visvalid = 0;
 
 		if (newtagset == ~0) {
 			selmon->pertag->prevtag = selmon->pertag->curtag;
@@ -2875,8 +4265,8 @@ toggleview(const Arg *arg)
 			togglebar(NULL);
 
 		focus(NULL);
-		set_net_current_desktop();
-		arrange(selmon);
+		defer(IdleCurrentDesktop);
+		setdirty(selmon, DirtyArrange);
 		Last_Event_Time = CurrentTime;
 	}
 }
@@ -2887,10 +4277,10 @@ unfocus(Client *c, int setfocus)
 	if (!c)
 		return;
 	grabbuttons(c, 0);
-	XSetWindowBorder(dpy, c->win, scheme[SchemeNorm][ColBorder].pixel);
+	setborder(c, scheme[SchemeNorm][ColBorder].pixel);
 	if (setfocus) {
 		XSetInputFocus(dpy, root, RevertToPointerRoot, CurrentTime);
-		XDeleteProperty(dpy, root, netatom[NetActiveWindow]);
+		setactivewindow(None);
 	}
 }
 
@@ -2899,42 +4289,53 @@ unmanage(Client *c, int destroyed)
 {
 	Monitor *m = c->mon;
 	XWindowChanges wc;
+	unsigned long first;
 
-	if (c->swallowing) {
+	if (c->ci->swallowing) {
 		unswallow(c);
 		return;
 	}
 
 	Client *s = swallowingclient(c->win);
 	if (s) {
-		free(s->swallowing);
-		s->swallowing = NULL;
-		arrange(m);
+		windel(c->win);
+		freeclient(s->ci->swallowing);
+		s->ci->swallowing = NULL;
+		setdirty(m, DirtyArrange);
+		commit();
         focus(getclientundermouse());
 		return;
 	}
 
+	markurgent(c, 0);
 	detach(c);
 	detachstack(c);
+	windel(c->win);
+	if (prevzoom == c)
+		prevzoom = NULL;
 	if (!destroyed) {
+		if (c->tagspending) /* manage() reads them back on remap */
+			settagsprop(c, c->tags);
+		if (c->ci->sh.netstatedirty)
+			flushnetstate(c);
 		XDeleteProperty(dpy, c->win, netatom[NetWMDesktop]);
-		wc.border_width = c->oldbw;
+		wc.border_width = c->ci->oldbw;
+		first = NextRequest(dpy);
 		XGrabServer(dpy); /* avoid race conditions */
-		XSetErrorHandler(xerrordummy);
 		XSelectInput(dpy, c->win, NoEventMask);
 		XConfigureWindow(dpy, c->win, CWBorderWidth, &wc); /* restore border */
 		XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
 		setclientstate(c, WithdrawnState);
-		XSync(dpy, False);
-		XSetErrorHandler(xerror);
 		XUngrabServer(dpy);
+		xignore(first);
 	}
-	free(c);
+	freeclient(c);
 
 	if (!s) {
-		arrange(m);
+		setdirty(m, DirtyArrange);
+		commit();
 		focus(getclientundermouse());
-		updateclientlist();
+		defer(IdleClientList);
 	}
 }
 
@@ -2954,7 +4355,7 @@ unmapnotify(XEvent *e)
 		/* KLUDGE! sometimes icons occasionally unmap their windows, but do
 		 * _not_ destroy them. We map those windows back */
 		XMapRaised(dpy, c->win);
-		updatesystray();
+		setdirty(selmon, DirtySystray);
 	}
 }
 
@@ -2980,12 +4381,14 @@ updatebars(void)
 		m->barwin = XCreateWindow(dpy, root, m->wx, m->by, w, bh, 0, depth,
 				InputOutput, visual,
 				CWOverrideRedirect|CWBackPixel|CWBorderPixel|CWColormap|CWEventMask, &wa);
+		winset(m->barwin, WinBar, m);
 		XChangeProperty(dpy, m->barwin, netatom[NetWMWindowType], XA_ATOM, 32,
 				PropModeReplace, (unsigned char *) &netatom[NetWMWindowTypeDock], 1);
 		XDefineCursor(dpy, m->barwin, cursor[CurNormal]->cursor);
 		if (showsystray && m == systraytomon(m))
 			XMapRaised(dpy, systray->win);
 		XMapRaised(dpy, m->barwin);
+		dropstacking();
 		XSetClassHint(dpy, m->barwin, &ch);
 	}
 }
@@ -3008,13 +4411,61 @@ updateclientlist(void)
 {
 	Client *c;
 	Monitor *m;
+	Window *w;
+	int n = 0;
 
-	XDeleteProperty(dpy, root, netatom[NetClientList]);
 	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next, n++);
+	w = ecalloc(n + 1, sizeof(Window));
+	for (n = 0, m = mons; m; m = m->next)
 		for (c = m->clients; c; c = c->next)
-			XChangeProperty(dpy, root, netatom[NetClientList],
-				XA_WINDOW, 32, PropModeAppend,
-				(unsigned char *) &(c->win), 1);
+			w[n++] = c->win;
+	publishlist(netatom[NetClientList], &clientlist, &nclientlist, w, n);
+}
+
+/* bottom to top, approximated by focus order: monitors in turn, least
+ * recently focused first */
+void
+updatestackinglist(void)
+{
+	Client *c;
+	Monitor *m;
+	Window *w;
+	int n = 0;
+
+	for (m = mons; m; m = m->next)
+		for (c = m->stack; c; c = c->snext, n++);
+	w = ecalloc(n + 1, sizeof(Window));
+	for (n = 0, m = mons; m; m = m->next)
+		for (c = m->stacktail; c; c = c->sprev)
+			w[n++] = c->win;
+	publishlist(netatom[NetClientListStacking], &stackinglist, &nstackinglist, w, n);
+}
+
+void
+updatedesktopnames(void)
+{
+	unsigned long i = LENGTH(tags);
+	XChangeProperty(dpy, root, netatom[NetNumberOfDesktops],
+			XA_CARDINAL, 32, PropModeReplace,
+			(unsigned char *) &i, 1);
+	XDeleteProperty(dpy, root, netatom[NetDesktopNames]);
+	char buf[26 * LENGTH(tags)], *p;
+	int tlen = 0;
+	for(i = 0, p = buf; i < LENGTH(tags); i++) {
+		const char *str; int len;
+		str = "Desktop "; len = strlen(str);
+		strcpy(p, str); p += len; tlen += len;
+		str = tags[i]; len = strlen(str);
+		strcpy(p, str); p += len; tlen += len;
+		if (*p != 0 || !(tlen < sizeof(buf) - 2)) {
+			die("ASSERT ERROR\n");
+		}
+		p++; tlen++;
+	}
+	XChangeProperty(dpy, root, netatom[NetDesktopNames],
+			utf8string, 8, PropModeReplace,
+			(unsigned char *) buf, tlen);
 }
 
 int
@@ -3065,7 +4516,7 @@ updategeom(void)
 			for (m = mons; m && m->next; m = m->next);
 			while ((c = m->clients)) {
 				dirty = 1;
-				m->clients = c->next;
+				detach(c);
 				detachstack(c);
 				c->mon = mons;
 				attach(c);
@@ -3111,6 +4562,20 @@ updatenumlockmask(void)
 	XFreeModifiermap(modmap);
 }
 
+void
+updateprotocols(Client *c)
+{
+	Atom *protocols;
+	int n;
+
+	c->ci->protocols = 0;
+	if (XGetWMProtocols(dpy, c->win, &protocols, &n)) {
+		while (n--)
+			c->ci->protocols |= protobit(protocols[n]);
+		XFree(protocols);
+	}
+}
+
 void
 updatesizehints(Client *c)
 {
@@ -3120,39 +4585,45 @@ updatesizehints(Client *c)
 	if (!XGetWMNormalHints(dpy, c->win, &size, &msize))
 		/* size is uninitialized, ensure that size.flags aren't used */
 		size.flags = PSize;
-	if (size.flags & PBaseSize) {
-		c->basew = size.base_width;
-		c->baseh = size.base_height;
-	} else if (size.flags & PMinSize) {
-		c->basew = size.min_width;
-		c->baseh = size.min_height;
+	setsizehints(c, &size);
+}
+
+void
+setsizehints(Client *c, XSizeHints *size)
+{
+	if (size->flags & PBaseSize) {
+		c->ci->basew = size->base_width;
+		c->ci->baseh = size->base_height;
+	} else if (size->flags & PMinSize) {
+		c->ci->basew = size->min_width;
+		c->ci->baseh = size->min_height;
 	} else
-		c->basew = c->baseh = 0;
-	if (size.flags & PResizeInc) {
-		c->incw = size.width_inc;
-		c->inch = size.height_inc;
+		c->ci->basew = c->ci->baseh = 0;
+	if (size->flags & PResizeInc) {
+		c->ci->incw = size->width_inc;
+		c->ci->inch = size->height_inc;
 	} else
-		c->incw = c->inch = 0;
-	if (size.flags & PMaxSize) {
-		c->maxw = size.max_width;
-		c->maxh = size.max_height;
+		c->ci->incw = c->ci->inch = 0;
+	if (size->flags & PMaxSize) {
+		c->ci->maxw = size->max_width;
+		c->ci->maxh = size->max_height;
 	} else
-		c->maxw = c->maxh = 0;
-	if (size.flags & PMinSize) {
-		c->minw = size.min_width;
-		c->minh = size.min_height;
-	} else if (size.flags & PBaseSize) {
-		c->minw = size.base_width;
-		c->minh = size.base_height;
+		c->ci->maxw = c->ci->maxh = 0;
+	if (size->flags & PMinSize) {
+		c->ci->minw = size->min_width;
+		c->ci->minh = size->min_height;
+	} else if (size->flags & PBaseSize) {
+		c->ci->minw = size->base_width;
+		c->ci->minh = size->base_height;
 	} else
-		c->minw = c->minh = 0;
-	if (size.flags & PAspect) {
-		c->mina = (float)size.min_aspect.y / size.min_aspect.x;
-		c->maxa = (float)size.max_aspect.x / size.max_aspect.y;
+		c->ci->minw = c->ci->minh = 0;
+	if (size->flags & PAspect) {
+		c->ci->mina = (float)size->min_aspect.y / size->min_aspect.x;
+		c->ci->maxa = (float)size->max_aspect.x / size->max_aspect.y;
 	} else
-		c->maxa = c->mina = 0.0;
-	c->isfixed = (c->maxw && c->maxh && c->maxw == c->minw && c->maxh == c->minh);
-	c->hintsvalid = 1;
+		c->ci->maxa = c->ci->mina = 0.0;
+	c->isfixed = (c->ci->maxw && c->ci->maxh && c->ci->maxw == c->ci->minw && c->ci->maxh == c->ci->minh);
+	c->ci->hintsvalid = 1;
 }
 
 void
@@ -3160,8 +4631,7 @@ updatestatus(void)
 {
 	if (!gettextprop(root, XA_WM_NAME, stext, sizeof(stext)))
 		strcpy(stext, "dwm-"VERSION);
-	drawbar(selmon);
-	updatesystray();
+	setdirty(selmon, DirtyStatus|DirtySystray);
 }
 
 void
@@ -3249,6 +4719,7 @@ updatesystray(void)
 				PropModeReplace, (unsigned char *)&netatom[NetSystemTrayOrientationHorz], 1);
 		XChangeWindowAttributes(dpy, systray->win, CWEventMask|CWOverrideRedirect|CWBackPixel, &wa);
 		XMapRaised(dpy, systray->win);
+		dropstacking();
 		XSetSelectionOwner(dpy, netatom[NetSystemTray], systray->win, CurrentTime);
 		if (XGetSelectionOwner(dpy, netatom[NetSystemTray]) == systray->win) {
 			sendevent(root, xatom[Manager], StructureNotifyMask, CurrentTime, netatom[NetSystemTray], systray->win, 0, 0);
@@ -3261,10 +4732,8 @@ updatesystray(void)
 			return;
 		}
 	}
+	defer(IdleSystray);
 	for (w = 0, i = systray->icons; i; i = i->next) {
-		/* make sure the background color stays the same */
-		wa.background_pixel  = scheme[SchemeNorm][ColBg].pixel;
-		XChangeWindowAttributes(dpy, i->win, CWBackPixel, &wa);
 		XMapRaised(dpy, i->win);
 		w += systrayspacing;
 		i->x = w;
@@ -3288,35 +4757,71 @@ updatesystray(void)
 	XSetForeground(dpy, drw->gc, scheme[SchemeNorm][ColBg].pixel);
 	XFillRectangle(dpy, systray->win, drw->gc, 0, 0, w, bh);
 #endif
-	XSync(dpy, False);
 }
 
 void
 updatetitle(Client *c)
 {
-	if (!gettextprop(c->win, netatom[NetWMName], c->name, sizeof c->name))
-		gettextprop(c->win, XA_WM_NAME, c->name, sizeof c->name);
-	if (c->name[0] == '\0') /* hack to mark broken clients */
-		strcpy(c->name, broken);
+	if (!gettextprop(c->win, netatom[NetWMName], c->ci->name, sizeof c->ci->name))
+		gettextprop(c->win, XA_WM_NAME, c->ci->name, sizeof c->ci->name);
+	if (c->ci->name[0] == '\0') /* hack to mark broken clients */
+		strcpy(c->ci->name, broken);
+}
+
+/* rebuild m's visible and tiled client arrays if attach(), detach() or a
+ * tags, tagset or floating change left them stale */
+void
+updatevis(Monitor *m)
+{
+	Client *c;
+	int n;
+
+	if (m->visvalid)
+		return;
+	for (n = 0, c = m->clients; c; c = c->next, n++);
+	if (n > m->viscap) {
+		m->viscap = MAX(n, 2 * m->viscap);
+		if (!(m->vis = realloc(m->vis, 3 * m->viscap * sizeof(Client *))))
+			die("fatal: could not malloc() %zu bytes\n", 3 * m->viscap * sizeof(Client *));
+	}
+	m->xvis = m->vis + m->viscap;
+	m->tiled = m->xvis + m->viscap;
+	m->nvis = m->nxvis = m->ntiled = 0;
+	for (c = m->clients; c; c = c->next) {
+		c->vispos = m->nvis;
+		c->xvispos = m->nxvis;
+		if (!ISVISIBLE(c))
+			continue;
+		m->vis[m->nvis++] = c;
+		if (c->tags != TAGMASK)
+			m->xvis[m->nxvis++] = c;
+		if (!c->isfloating)
+			m->tiled[m->ntiled++] = c;
+	}
+	m->visvalid = 1;
 }
 
 void
 updatewindowtype(Client *c)
 {
-	Atom state = getatomprop(c, netatom[NetWMState]);
-	Atom wtype = getatomprop(c, netatom[NetWMWindowType]);
+	setwindowtype(c, netstateop(c, netatom[NetWMFullscreen], 0)
+		      ? netatom[NetWMFullscreen] : None,
+	              getatomprop(c, netatom[NetWMWindowType]));
+}
 
+void
+setwindowtype(Client *c, Atom state, Atom wtype)
+{
 	if (state == netatom[NetWMFullscreen])
 		setfullscreen(c, 1);
-	if (wtype == netatom[NetWMWindowTypeDialog])
+	if (wtype == netatom[NetWMWindowTypeDialog]) {
 		c->isfloating = 1;
-	else if (wtype == netatom[NetWMWindowTypeDesktop]) {
+		c->mon->visvalid = 0;
+	} else if (wtype == netatom[NetWMWindowTypeDesktop]) {
 		c->isdesktop = c->isfloating = c->isfixed = 1;
+		c->mon->visvalid = 0;
 		// put the "desktop window" on all "desktops"
-		int x = -1;
-		XChangeProperty(dpy, c->win, netatom[NetWMDesktop],
-				XA_CARDINAL, 32, PropModeReplace,
-				(unsigned char *) &x, 1);
+		setdesktopprop(c, -1);
 	}
 }
 
@@ -3326,19 +4831,27 @@ updatewmhints(Client *c)
 	XWMHints *wmh;
 
 	if ((wmh = XGetWMHints(dpy, c->win))) {
-		if (c == selmon->sel && wmh->flags & XUrgencyHint) {
-			wmh->flags &= ~XUrgencyHint;
-			XSetWMHints(dpy, c->win, wmh);
-		} else
-			c->isurgent = (wmh->flags & XUrgencyHint) ? 1 : 0;
-		if (wmh->flags & InputHint)
-			c->neverfocus = !wmh->input;
-		else
-			c->neverfocus = 0;
+		setwmhints(c, wmh);
 		XFree(wmh);
 	}
 }
 
+void
+setwmhints(Client *c, XWMHints *wmh)
+{
+	if (c == selmon->sel && wmh->flags & XUrgencyHint) {
+		wmh->flags &= ~XUrgencyHint;
+		XSetWMHints(dpy, c->win, wmh);
+	} else
+		markurgent(c, (wmh->flags & XUrgencyHint) ? 1 : 0);
+	c->ci->wmh = *wmh;
+	c->ci->haswmh = 1;
+	if (wmh->flags & InputHint)
+		c->neverfocus = !wmh->input;
+	else
+		c->neverfocus = 0;
+}
+
 void
 view(const Arg *arg)
 {
@@ -3348,6 +4861,7 @@ view(const Arg *arg)
 	if ((arg->ui & TAGMASK) == selmon->tagset[selmon->seltags])
 		return;
 	selmon->seltags ^= 1; /* toggle sel tagset */
+	selmon->visvalid = 0;
 	if (arg->ui & TAGMASK) {
 		selmon->tagset[selmon->seltags] = arg->ui & TAGMASK;
 		selmon->pertag->prevtag = selmon->pertag->curtag;
@@ -3374,8 +4888,8 @@ view(const Arg *arg)
 		togglebar(NULL);
 
 	focus(NULL);
-	set_net_current_desktop();
-	arrange(selmon);
+	defer(IdleCurrentDesktop);
+	setdirty(selmon, DirtyArrange);
 	Last_Event_Time = CurrentTime;
 }
 
@@ -3414,12 +4928,12 @@ termforwin(const Client *w)
 	Client *c;
 	Monitor *m;
 
-	if (!w->pid || w->isterminal)
+	if (!w->ci->pid || w->ci->isterminal)
 		return NULL;
 
 	for (m = mons; m; m = m->next) {
 		for (c = m->clients; c; c = c->next) {
-			if (c->isterminal && !c->swallowing && c->pid && isdescprocess(c->pid, w->pid))
+			if (c->ci->isterminal && !c->ci->swallowing && c->ci->pid && isdescprocess(c->ci->pid, w->ci->pid))
 				return c;
 		}
 	}
@@ -3430,17 +4944,9 @@ termforwin(const Client *w)
 Client *
 swallowingclient(Window w)
 {
-	Client *c;
-	Monitor *m;
-
-	for (m = mons; m; m = m->next) {
-		for (c = m->clients; c; c = c->next) {
-			if (c->swallowing && c->swallowing->win == w)
-				return c;
-		}
-	}
+	WinRec *r = winfind(w);
 
-	return NULL;
+	return r && r->kind == WinSwallowed ? r->p : NULL;
 }
 
 static void
@@ -3464,44 +4970,109 @@ WARP(const Client *c) {
 	XWarpPointer(dpy, None, c->win, 0, 0, 0, 0, c->w, 0);
 }
 
+unsigned int
+winhash(Window w)
+{
+	return (unsigned int)(((uint64_t)w * 0x9e3779b97f4a7c15ULL) >> 32) & (wintabsz - 1);
+}
+
+void
+windel(Window w)
+{
+	unsigned int i, j, k;
+
+	if (!winfind(w))
+		return;
+	for (i = winhash(w); wintab[i].win != w; i = (i + 1) & (wintabsz - 1));
+	/* shift later members of the probe run back into the hole */
+	for (j = i; ; ) {
+		wintab[i].kind = WinNone;
+		do {
+			j = (j + 1) & (wintabsz - 1);
+			if (wintab[j].kind == WinNone) {
+				wintabn--;
+				return;
+			}
+			k = winhash(wintab[j].win);
+		} while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+		wintab[i] = wintab[j];
+		i = j;
+	}
+}
+
+WinRec *
+winfind(Window w)
+{
+	unsigned int i;
+
+	if (!wintabsz)
+		return NULL;
+	for (i = winhash(w); wintab[i].kind != WinNone; i = (i + 1) & (wintabsz - 1))
+		if (wintab[i].win == w)
+			return &wintab[i];
+	return NULL;
+}
+
+void
+winset(Window w, int kind, void *p)
+{
+	WinRec *r, *old;
+	unsigned int i, oldsz;
+
+	if ((r = winfind(w))) {
+		r->kind = kind;
+		r->p = p;
+		return;
+	}
+	if (2 * (wintabn + 1) > wintabsz) {
+		/* keep the load at most 1/2 so probe runs stay short */
+		old = wintab;
+		oldsz = wintabsz;
+		wintabsz = wintabsz ? 2 * wintabsz : 64;
+		wintab = ecalloc(wintabsz, sizeof(WinRec));
+		wintabn = 0;
+		for (i = 0; i < oldsz; i++)
+			if (old[i].kind != WinNone)
+				winset(old[i].win, old[i].kind, old[i].p);
+		free(old);
+	}
+	for (i = winhash(w); wintab[i].kind != WinNone; i = (i + 1) & (wintabsz - 1));
+	wintab[i].win = w;
+	wintab[i].kind = kind;
+	wintab[i].p = p;
+	wintabn++;
+}
+
 Client *
 wintoclient(Window w)
 {
-	Client *c;
-	Monitor *m;
+	WinRec *r = winfind(w);
 
-	for (m = mons; m; m = m->next)
-		for (c = m->clients; c; c = c->next)
-			if (c->win == w)
-				return c;
-	return NULL;
+	return r && r->kind == WinClient ? r->p : NULL;
 }
 
 Monitor *
 wintomon(Window w)
 {
 	int x, y;
-	Client *c;
-	Monitor *m;
+	WinRec *r;
 
 	if (w == root && getrootptr(&x, &y))
 		return recttomon(x, y, 1, 1);
-	for (m = mons; m; m = m->next)
-		if (w == m->barwin)
-			return m;
-	if ((c = wintoclient(w)))
-		return c->mon;
+	if ((r = winfind(w)) && r->kind == WinBar)
+		return r->p;
+	if (r && r->kind == WinClient)
+		return ((Client *)r->p)->mon;
 	return selmon;
 }
 
 Client *
 wintosystrayicon(Window w) {
-	Client *i = NULL;
+	WinRec *r;
 
 	if (!showsystray || !w)
-		return i;
-	for (i = systray->icons; i && i->win != w; i = i->next) ;
-	return i;
+		return NULL;
+	return (r = winfind(w)) && r->kind == WinIcon ? r->p : NULL;
 }
 
 /* There's no way to check accesses to destroyed windows, thus those cases are
@@ -3510,6 +5081,11 @@ wintosystrayicon(Window w) {
 int
 xerror(Display *dpy, XErrorEvent *ee)
 {
+	unsigned int i;
+
+	for (i = 0; i < LENGTH(ignores); i++)
+		if (ee->serial >= ignores[i].first && ee->serial <= ignores[i].last)
+			return 0;
 	if (ee->error_code == BadWindow
 	|| (ee->request_code == X_SetInputFocus && ee->error_code == BadMatch)
 	|| (ee->request_code == X_PolyText8 && ee->error_code == BadDrawable)
@@ -3525,12 +5101,6 @@ xerror(Display *dpy, XErrorEvent *ee)
 	return xerrorxlib(dpy, ee); /* may call exit */
 }
 
-int
-xerrordummy(Display *dpy, XErrorEvent *ee)
-{
-	return 0;
-}
-
 /* Startup Error handler to check if another window manager
  * is already running. */
 int
@@ -3540,6 +5110,16 @@ xerrorstart(Display *dpy, XErrorEvent *ee)
 	return -1;
 }
 
+/* drop any error caused by the requests sent since serial first, without
+ * waiting for the server to process them */
+void
+xignore(unsigned long first)
+{
+	ignores[ignorenext].first = first;
+	ignores[ignorenext].last = NextRequest(dpy) - 1;
+	ignorenext = (ignorenext + 1) % LENGTH(ignores);
+}
+
 void
 xinitvisual()
 {
@@ -3600,12 +5180,11 @@ zoom(const Arg *arg)
 			prevzoom = cold;
 			if (cold && at != cold) {
 				detach(cold);
-				cold->next = at->next;
-				at->next = cold;
+				attachafter(cold, at);
 			}
 		}
 		focus(c);
-		arrange(c->mon);
+		setdirty(c->mon, DirtyArrange);
 	}
 }
 
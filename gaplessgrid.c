@@ -3,8 +3,8 @@ gaplessgrid(Monitor *m) {
 	unsigned int n, cols, rows, cn, rn, i, cx, cy, cw, ch;
 	Client *c;
 
-	for(n = 0, c = nexttiled(m->clients); c; c = nexttiled(c->next), n++) ;
-	if(n == 0)
+	updatevis(m);
+	if((n = m->ntiled) == 0)
 		return;
 
 	/* grid dimensions */
@@ -19,7 +19,8 @@ gaplessgrid(Monitor *m) {
 	cw = cols ? m->ww / cols : m->ww;
 	cn = 0; /* current column number */
 	rn = 0; /* current row number */
-	for(i = 0, c = nexttiled(m->clients); c; i++, c = nexttiled(c->next)) {
+	for(i = 0; i < n; i++) {
+		c = m->tiled[i];
 		if(i/rows + 1 > cols - n%cols)
 			rows = n/cols + 1;
 		ch = rows ? m->wh / rows : m->wh;
@@ -13,11 +13,11 @@ static void
 identify_wintitle(const Arg *arg)
 {
 	Client * c;
-	if (selmon && (c = selmon->sel) && c->name[0]) {
+	if (selmon && (c = selmon->sel) && c->ci->name[0]) {
 		int x = TEXTW("XXXXXXX");
 		char buf[600];
 		snprintf(buf, sizeof(buf),
-			 "%s, pid %d, %d", c->name, c->pid,
+			 "%s, pid %d, %d", c->ci->name, c->ci->pid,
 			 getcardprop(c, netatom[NetWMPid]));
 		int w = TEXTW(buf);
 		drw_setscheme(drw, scheme[SchemeSel]);
@@ -33,7 +33,7 @@ myfocus(const Arg *arg) {
 		fprintf(stderr,"myfocus(NULL): failed\n");
 	} else if (raise_on_click) {
 		c->raiseme = 1;
-		restack(selmon);
+		setdirty(selmon, DirtyStack);
 	}
 	XAllowEvents(dpy,ReplayPointer,CurrentTime);
 	XAllowEvents(dpy, AsyncKeyboard, CurrentTime);
@@ -61,6 +61,14 @@ startwm(const Arg *arg) {
 				setfullscreen(c,False);
 	}
 
+	commit();
+	idle(NULL);
+	XSync(dpy, False); // nothing may be left in the output buffer
+	{ // the exec'd program must not inherit our blocked SIGCHLD
+		sigset_t mask;
+		sigemptyset(&mask);
+		sigprocmask(SIG_SETMASK, &mask, NULL);
+	}
 	fprintf(stderr, "startwm: execlp '%s -c %s'", shell, (char *) arg->v);
 	execlp(shell, shell, "-c", (char *) arg->v, (char *)NULL);
 }
@@ -69,7 +77,7 @@ static void
 toggle_fixed(const Arg * arg) {
 	if(!selmon->sel)
 		return;
-	fprintf(stderr,"toggle_fixed: %s->isfixed=%d\n",selmon->sel->name,selmon->sel->isfixed);
+	fprintf(stderr,"toggle_fixed: %s->isfixed=%d\n",selmon->sel->ci->name,selmon->sel->isfixed);
 	if (selmon->sel->isfixed == True)
 		selmon->sel->isfixed = False;
 	else
@@ -90,16 +98,13 @@ windowlist(const Arg *arg) {
 	int out[2], nts[2], cpid, i, j;
 	char *argv[] = {"dmenu", "-l", "50", "-i", NULL };
 	FILE *fout;
-#ifdef HAVE_USE_SIGACTION_SIGCHLD
 	struct sigaction sa;
-#endif
 
 	if (pipe(out) == -1) { perror("windowlist: pipe(out)"); return; }
 	if (pipe(nts) == -1) { perror("windowlist: pipe(nts)"); return; }
 	if ((cpid = fork()) == -1) { perror("windowlist: fork()"); return;}
 
 	if (cpid == 0) { // child reads from NTS and writes to OUT
-#ifdef HAVE_USE_SIGACTION_SIGCHLD
 // ;madhu 240201 restoring SIGCHLD handler in child has no effect
 // on the parent.
 		setsid();
@@ -107,7 +112,7 @@ windowlist(const Arg *arg) {
 		sa.sa_flags = 0;
 		sa.sa_handler = SIG_DFL;
 		sigaction(SIGCHLD, &sa, NULL);
-#endif
+		sigprocmask(SIG_SETMASK, &sa.sa_mask, NULL);
 		close(nts[1]);
 		if (dup2(nts[0], STDIN_FILENO) == -1)
 		{fprintf(stderr, "child:dup2(nts[0]=%d,stdin=%d)\n",
@@ -134,7 +139,7 @@ windowlist(const Arg *arg) {
 	}
 
 	for (c = selmon->clients, i = 0; c; c= c->next, i++) { //FIXME - all monitors
-		fprintf(fout, "%10d | %60.60s | 0x%7.7lx\n",  i,  c->name, c->win);
+		fprintf(fout, "%10d | %60.60s | 0x%7.7lx\n",  i,  c->ci->name, c->win);
 		fflush(fout);
 	}
 	close(nts[1]);
@@ -180,27 +185,27 @@ windowlist(const Arg *arg) {
 static void toggleopacity(const Arg *arg) {
 	if(!selmon->sel)
 		return;
-	fprintf(stderr,"%s->opacity=%g",selmon->sel->name,selmon->sel->opacity);
+	fprintf(stderr,"%s->opacity=%g",selmon->sel->ci->name,selmon->sel->ci->opacity);
 	if (arg->f == 0) {	// toggle-opacity
-		if (selmon->sel->opacity <= -1)
-			selmon->sel->opacity = shade;
-		else if ((-1 < selmon->sel->opacity) &&
-		    (selmon->sel->opacity < 0))
-			selmon->sel->opacity += 1;
-		else if ((0  <= selmon->sel->opacity) &&
-			 (selmon->sel->opacity < 1))
-			selmon->sel->opacity -= 1;
+		if (selmon->sel->ci->opacity <= -1)
+			selmon->sel->ci->opacity = shade;
+		else if ((-1 < selmon->sel->ci->opacity) &&
+		    (selmon->sel->ci->opacity < 0))
+			selmon->sel->ci->opacity += 1;
+		else if ((0  <= selmon->sel->ci->opacity) &&
+			 (selmon->sel->ci->opacity < 1))
+			selmon->sel->ci->opacity -= 1;
 		else
-			selmon->sel->opacity = -1;
+			selmon->sel->ci->opacity = -1;
 	} else {
-		selmon->sel->opacity += arg->f;
-		if (selmon->sel->opacity < 0)
-			selmon->sel->opacity = 1;
-		else if (selmon->sel->opacity > 1)
-			selmon->sel->opacity = 0.1;
+		selmon->sel->ci->opacity += arg->f;
+		if (selmon->sel->ci->opacity < 0)
+			selmon->sel->ci->opacity = 1;
+		else if (selmon->sel->ci->opacity > 1)
+			selmon->sel->ci->opacity = 0.1;
 	}
-	fprintf(stderr,"==>%g\n",selmon->sel->opacity);
-	window_opacity_set(selmon->sel, selmon->sel->opacity);
+	fprintf(stderr,"==>%g\n",selmon->sel->ci->opacity);
+	window_opacity_set(selmon->sel, selmon->sel->ci->opacity);
 }
 
 static void toggle_systray () {
@@ -213,12 +218,17 @@ focusurgent(const Arg *arg)
 {
 	Client *c;
 	int i;
-	for(c=selmon->clients; c && !c->isurgent; c=c->next);
-	if(c) {
+	/* oldest urgent client first; focus() drops it from the queue */
+	if((c = urgent)) {
+		if(c->mon != selmon) {
+			unfocus(selmon->sel, 0);
+			selmon = c->mon;
+		}
 		for(i=0; i < LENGTH(tags) && !((1 << i) & c->tags); i++);
 		if(i < LENGTH(tags)) {
 			const Arg a = {.ui = 1 << i};
 			view(&a);
+			commit();
 			WARP(c);
 			focus(c);
 		}
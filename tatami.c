@@ -2,11 +2,11 @@ void
 tatami(Monitor *m) {
 	unsigned int i, n, nx, ny, nw, nh,
 				 mats, tc,
-				 tnx, tny, tnw, tnh;
+				 tnx, tny, tnw, tnh, t = 0;
 	Client *c;
 
-	for(n = 0, c = nexttiled(m->clients); c; c = nexttiled(c->next), ++n);
-	if(n == 0)
+	updatevis(m);
+	if((n = m->ntiled) == 0)
 		return;
 
 	nx = m->wx;
@@ -14,14 +14,14 @@ tatami(Monitor *m) {
 	nw = m->ww;
 	nh = m->wh;
 
-	c = nexttiled(m->clients);
+	c = m->tiled[0];
 
 	if(n != 1)  nw = m->ww * 0.6; //m->mfact;
 				ny = m->wy;
 
 	resize(c, nx, ny, nw - 2 * c->bw, nh - 2 * c->bw, False);
 
-	c = nexttiled(c->next);
+	c = ++t < n ? m->tiled[t] : NULL;
 
 	nx += nw;
 	nw = m->ww - nw;
@@ -34,7 +34,7 @@ tatami(Monitor *m) {
 
 	nh/=(mats + (tc % 5 > 0));
 
-	for(i = 0; c && (i < (tc % 5)); c = nexttiled(c->next))
+	for(i = 0; c && (i < (tc % 5)); c = ++t < n ? m->tiled[t] : NULL)
 	{
 		tnw=nw;
 		tnx=nx;
@@ -102,7 +102,7 @@ tatami(Monitor *m) {
 
 	++mats;
 
-	for(i = 0; c && (mats>0); c = nexttiled(c->next)) {
+	for(i = 0; c && (mats>0); c = ++t < n ? m->tiled[t] : NULL) {
 
 			if((i%5)==0)
 			{
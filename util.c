@@ -7,6 +7,17 @@
 
 #include "util.h"
 
+#define SLABSIZE  4096
+#define POOLALIGN 64 /* cache line: slots start on one, so do records */
+#ifdef POOLDEBUG
+#define POOLLIVE  0x4c495645L /* "LIVE" */
+#define POOLFREE  0x46524545L   /* "FREE" */
+#define POISON    0xa5
+#define HDR       POOLALIGN
+#else
+#define HDR       0
+#endif
+
 void
 die(const char *fmt, ...)
 {
@@ -35,3 +46,104 @@ ecalloc(size_t nmemb, size_t size)
 		die("calloc:");
 	return p;
 }
+
+#ifdef POOLDEBUG
+static void
+poolcheck(const Pool *p, unsigned char *slot)
+{
+	size_t i;
+
+	if (*(long *)slot != POOLFREE)
+		die("pool: corrupt free list at %p", (void *)(slot + HDR));
+	for (i = HDR + sizeof(void *); i < HDR + p->size; i++)
+		if (slot[i] != POISON)
+			die("pool: write after free to %p+%zu", (void *)(slot + HDR), i - HDR);
+}
+#endif
+
+static void
+poolgrow(Pool *p)
+{
+	unsigned char *slab;
+	void **slabs;
+	size_t i;
+
+	if (!p->slotsz) {
+		p->slotsz = HDR + (p->size + POOLALIGN - 1) / POOLALIGN * POOLALIGN;
+		p->perslab = MAX(SLABSIZE / p->slotsz, 8);
+	}
+	if (!(slabs = realloc(p->slabs, (p->nslabs + 1) * sizeof *slabs)))
+		die("realloc:");
+	p->slabs = slabs;
+	if ((errno = posix_memalign((void **)&slab, POOLALIGN, p->perslab * p->slotsz)))
+		die("posix_memalign:");
+	p->slabs[p->nslabs++] = slab;
+	for (i = p->perslab; i-- > 0; ) {
+#ifdef POOLDEBUG
+		*(long *)(slab + i * p->slotsz) = POOLFREE;
+		memset(slab + i * p->slotsz + HDR, POISON, p->size);
+#endif
+		*(void **)(slab + i * p->slotsz + HDR) = p->free;
+		p->free = slab + i * p->slotsz;
+	}
+	p->total += p->perslab;
+}
+
+/* returns a zeroed record, never NULL */
+void *
+palloc(Pool *p)
+{
+	unsigned char *slot;
+
+	if (!p->free)
+		poolgrow(p);
+	slot = p->free;
+#ifdef POOLDEBUG
+	poolcheck(p, slot);
+	*(long *)slot = POOLLIVE;
+#endif
+	p->free = *(void **)(slot + HDR);
+	p->inuse++;
+	memset(slot + HDR, 0, p->size);
+	return slot + HDR;
+}
+
+void
+pfree(Pool *p, void *o)
+{
+	unsigned char *slot;
+
+	if (!o)
+		return;
+	slot = (unsigned char *)o - HDR;
+#ifdef POOLDEBUG
+	if (*(long *)slot != POOLLIVE)
+		die("pool: %s of %p", *(long *)slot == POOLFREE ?
+		    "double free" : "bad free", o);
+	*(long *)slot = POOLFREE;
+	memset(o, POISON, p->size);
+#endif
+	*(void **)o = p->free;
+	p->free = slot;
+	p->inuse--;
+}
+
+/* releases every slab; records still in use become invalid */
+void
+pooldestroy(Pool *p)
+{
+	while (p->nslabs)
+		free(p->slabs[--p->nslabs]);
+	free(p->slabs);
+	p->slabs = NULL;
+	p->free = NULL;
+	p->inuse = p->total = 0;
+}
+
+void
+poolstats(const Pool *p, size_t *inuse, size_t *total, size_t *nslabs)
+{
+	*inuse = p->inuse;
+	*total = p->total;
+	*nslabs = p->nslabs;
+}
@@ -7,3 +7,20 @@
 
 void die(const char *fmt, ...);
 void *ecalloc(size_t nmemb, size_t size);
+
+/* fixed-size records carved from contiguous slabs; zero-initialise with
+ * { sizeof(T) } and the first palloc() sets up the rest */
+typedef struct {
+	size_t size;     /* record size */
+	size_t slotsz;   /* record size rounded up, plus debug header */
+	size_t perslab;  /* records per slab */
+	size_t inuse, total;
+	void *free;      /* free list, linked through the first word */
+	void **slabs;
+	size_t nslabs;
+} Pool;
+
+void *palloc(Pool *p);
+void pfree(Pool *p, void *o);
+void pooldestroy(Pool *p);
+void poolstats(const Pool *p, size_t *inuse, size_t *total, size_t *nslabs);